@@ -1,6 +1,9 @@
 #ifndef _24C32_H_
 #define _24C32_H_
 
+// i2c address of the AT24C32 on the DS3231 board
+#define AT24_I2C_ADDR		0xAE
+
 /**
  * AT24C32 Internal memory organization:
  * each page is 32 Bytes long, so we have
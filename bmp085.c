@@ -28,8 +28,13 @@
 * NOTE: SCL and SDA needs pull-up resistors for each I2C bus.               *
 *  2.2kOhm..10kOhm, typ. 4.7kOhm                                            *
 *****************************************************************************/
-#include <util/delay.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stddef.h>
+#include <avr/pgmspace.h>
 #include "i2c.h"
+#include "timer.h"
+#include "errorno.h"
 #include "bmp085.h"
 
 #define BUFFER_SIZE					3
@@ -50,6 +55,7 @@
 #define CAL_MB						0xBA	// R   Calibration data (16 bits)
 #define CAL_MC						0xBC	// R   Calibration data (16 bits)
 #define CAL_MD						0xBE	// R   Calibration data (16 bits)
+#define CAL_SIZE					22		// AC1..MD, read in one burst
 #define CONTROL						0xF4	// W   Control register
 #define CONTROL_OUTPUT				0xF6	// R   Output registers 0xF6=MSB, 0xF7=LSB, 0xF8=XLSB
 
@@ -65,43 +71,260 @@
 // Control register
 #define READ_TEMPERATURE			0x2E
 #define READ_PRESSURE				0x34
+// Max conversion times, us
+#define CONV_TEMPERATURE_US			4500
+static const uint16_t _convPressureUs[] = { 4500, 7500, 13500, 25500 };	// per _oss
 //Other
 #define MSLP						101325	// Mean Sea Level Pressure = 1013.25 hPA (1hPa = 100Pa = 1mbar)
 
 static int16_t ac1,ac2,ac3,b1,b2,mb,mc,md;			// cal data
 static uint16_t ac4,ac5,ac6;						// cal data
-static long b5, oldEMA;								// temperature data
+static long b5;										// temperature data
 static uint8_t _dev_address;
 static uint8_t _buff[BUFFER_SIZE];					// buffer  MSB LSB XLSB
 static uint8_t _oss;								// OverSamplingSetting
+static uint8_t _calValid;							// cal data read and checked
+static uint8_t _conv;								// conversion running, BMP085_CONV_*
+static unsigned long _convStart;					// micros() when it was started
+static uint16_t _convUs;							// its max conversion time
+static uint8_t _meas;								// measure() step, BMP085_CONV_*
+static uint8_t _tempValid;							// b5 holds a measured temperature
+static unsigned long _tempTime;						// millis() when it was measured
+static uint16_t _tempMs;							// reuse it that long, 0 = never
+
+/*
+ * Background sampling, see startSampling(). Everything below is
+ * owned by the timer tick while _sample is not SAMPLE_OFF.
+ */
+#define SAMPLE_TEMP_MS				1000	// temperature conversion period
+#define SAMPLE_OFF					0
+#define SAMPLE_IDLE					1		// next conversion to start
+#define SAMPLE_START				2		// command on the bus
+#define SAMPLE_CONV					3		// chip converting
+#define SAMPLE_READ					4		// result on the bus
+
+static volatile uint8_t _sample;					// SAMPLE_*
+static uint8_t _sampleConv;							// BMP085_CONV_* running
+static volatile unsigned long _sampleStart;			// micros() when it was started
+static unsigned long _sampleTemp;					// millis() of the last temperature
+static uint8_t _sampleHasTemp;
+static uint8_t _sampleCmd[2];
+static uint8_t _sampleBuf[BUFFER_SIZE];
+static struct I2CXfer _sampleXfer;
+static uint8_t _decimation;							// samples per output
+static uint8_t _count;
+static uint32_t _upSum;								// raw pressure sum of this output
+static volatile uint8_t _outReady;					// output not taken yet
+static uint32_t _outSum;
+static long _outB5;
 
 int32_t _cm_Offset, _Pa_Offset;
-int32_t _param_datum, _param_centimeters;
+// Reference, sea level standard pressure until one is set
+int32_t _param_datum = MSLP, _param_centimeters;
+static uint32_t _reduction = 1UL << 24;				// 1.0 in Q8.24, see updateReduction()
+
+static uint8_t getCalData(void);
+static void stopSampling(void);
+
+/*
+ * Fixed-point replacements for pow(), used by the barometric formula.
+ * x^k is computed as 2^(k * log2(x)), with log2() and 2^x taken from
+ * tables of the deviation from a straight line, log2(1 + f) - f and
+ * 1 + f - 2^f, f = 0..1, interpolated linearly over LOG_TABLE_SIZE
+ * steps. Logarithms and exponents are Q8.24.
+ *
+ * Both curves deviate from the line by at most 0.0861, so the tables
+ * keep it with 2^-19 resolution, each node is raised by half the chord
+ * sag to centre the interpolation error. The errors add up to 2.2e-6
+ * of log2() and 1.7e-6 of 2^x; against the float formulas over
+ * 300..1100 hPa that is at most 2 Pa of reduced pressure and 12 cm of
+ * altitude for datums of 600..1200 hPa, 30 cm for the 740 Pa one of
+ * main.c; below the RMS noise of the sensor (3..6 Pa, 25..50 cm).
+ */
+#define LOG_TABLE_SIZE				256
+#define LOG_FRAC_BITS				24
+#define POW_EXP_PRESSURE			88164270UL	// 5.255 in Q8.24
+#define POW_EXP_ALTITUDE			3192704UL	// 0.1903 in Q8.24
+#define ALT_SCALE					4433000L	// 44330 m in centimeters
+
+static const uint16_t _log2Dev[LOG_TABLE_SIZE] PROGMEM = {
+	    1,   902,  1791,  2669,  3536,  4391,  5236,  6069,
+	 6892,  7704,  8505,  9295, 10074, 10844, 11602, 12350,
+	13088, 13816, 14534, 15241, 15939, 16626, 17304, 17972,
+	18630, 19279, 19918, 20547, 21167, 21778, 22379, 22971,
+	23554, 24128, 24693, 25248, 25795, 26333, 26862, 27383,
+	27894, 28397, 28892, 29378, 29855, 30325, 30785, 31238,
+	31682, 32118, 32546, 32966, 33377, 33781, 34177, 34565,
+	34945, 35318, 35683, 36040, 36389, 36731, 37065, 37392,
+	37711, 38024, 38328, 38626, 38916, 39199, 39474, 39743,
+	40005, 40259, 40507, 40747, 40981, 41208, 41428, 41641,
+	41848, 42048, 42241, 42427, 42607, 42781, 42947, 43108,
+	43262, 43410, 43551, 43686, 43814, 43937, 44053, 44163,
+	44267, 44365, 44456, 44542, 44622, 44695, 44763, 44825,
+	44881, 44931, 44976, 45014, 45047, 45074, 45096, 45111,
+	45122, 45126, 45125, 45119, 45107, 45089, 45067, 45038,
+	45005, 44966, 44921, 44872, 44817, 44757, 44691, 44621,
+	44545, 44464, 44378, 44287, 44191, 44090, 43984, 43873,
+	43757, 43636, 43511, 43380, 43244, 43104, 42959, 42809,
+	42654, 42495, 42331, 42162, 41989, 41811, 41628, 41441,
+	41249, 41052, 40852, 40646, 40436, 40222, 40003, 39780,
+	39552, 39320, 39084, 38844, 38599, 38349, 38096, 37838,
+	37576, 37310, 37040, 36765, 36487, 36204, 35917, 35626,
+	35331, 35032, 34728, 34421, 34110, 33795, 33476, 33153,
+	32826, 32495, 32160, 31821, 31479, 31133, 30782, 30428,
+	30071, 29709, 29344, 28975, 28602, 28226, 27846, 27462,
+	27074, 26683, 26289, 25890, 25489, 25083, 24674, 24261,
+	23845, 23426, 23003, 22576, 22146, 21712, 21276, 20835,
+	20391, 19944, 19494, 19040, 18582, 18122, 17658, 17191,
+	16720, 16246, 15769, 15289, 14805, 14318, 13828, 13335,
+	12839, 12339, 11836, 11330, 10821, 10309,  9794,  9275,
+	 8754,  8229,  7702,  7171,  6637,  6101,  5561,  5018,
+	 4472,  3924,  3372,  2817,  2260,  1699,  1136,   569,
+};
 
-static void getCalData(void);
+static const uint16_t _exp2Dev[LOG_TABLE_SIZE] PROGMEM = {
+	    0,   627,  1249,  1868,  2483,  3094,  3701,  4305,
+	 4904,  5499,  6091,  6678,  7262,  7841,  8417,  8988,
+	 9556, 10120, 10679, 11235, 11786, 12334, 12877, 13416,
+	13951, 14482, 15009, 15532, 16051, 16565, 17076, 17582,
+	18084, 18582, 19076, 19565, 20050, 20531, 21008, 21480,
+	21949, 22413, 22872, 23328, 23779, 24225, 24667, 25105,
+	25539, 25968, 26393, 26814, 27230, 27641, 28048, 28451,
+	28849, 29243, 29632, 30017, 30397, 30773, 31144, 31511,
+	31873, 32231, 32584, 32932, 33276, 33615, 33950, 34279,
+	34605, 34925, 35241, 35552, 35859, 36160, 36457, 36750,
+	37037, 37320, 37598, 37871, 38139, 38403, 38661, 38915,
+	39164, 39408, 39647, 39882, 40111, 40335, 40555, 40769,
+	40979, 41183, 41383, 41578, 41767, 41952, 42131, 42305,
+	42475, 42639, 42798, 42952, 43101, 43244, 43383, 43516,
+	43644, 43767, 43885, 43998, 44105, 44207, 44303, 44395,
+	44481, 44562, 44637, 44707, 44772, 44831, 44885, 44934,
+	44977, 45015, 45047, 45074, 45095, 45111, 45121, 45126,
+	45125, 45119, 45107, 45090, 45067, 45038, 45004, 44964,
+	44918, 44867, 44810, 44747, 44679, 44605, 44525, 44439,
+	44348, 44250, 44147, 44038, 43924, 43803, 43676, 43544,
+	43406, 43262, 43111, 42955, 42793, 42625, 42451, 42271,
+	42085, 41892, 41694, 41490, 41279, 41062, 40840, 40611,
+	40376, 40134, 39887, 39633, 39373, 39107, 38834, 38556,
+	38271, 37979, 37681, 37377, 37067, 36750, 36427, 36097,
+	35761, 35418, 35069, 34713, 34351, 33982, 33607, 33225,
+	32837, 32442, 32040, 31632, 31217, 30796, 30367, 29932,
+	29490, 29042, 28587, 28125, 27656, 27180, 26698, 26208,
+	25712, 25209, 24699, 24182, 23658, 23127, 22589, 22044,
+	21492, 20933, 20367, 19794, 19213, 18626, 18031, 17430,
+	16821, 16205, 15581, 14951, 14313, 13668, 13015, 12356,
+	11689, 11014, 10332,  9643,  8947,  8242,  7531,  6812,
+	 6085,  5351,  4610,  3860,  3104,  2339,  1567,   788,
+};
 
-static void writemem(uint8_t _addr, uint8_t _val)
+static uint16_t _devAt(const uint16_t *_table, uint16_t _i)
 {
-	I2CStart(_dev_address);   // start transmission to device
-	I2CWriteByte(_addr); // send register address
-	I2CWriteByte(_val); // send value to write
-	I2CStop(); // end transmission
+	// both deviations are back to zero at f = 1
+	return _i < LOG_TABLE_SIZE ? pgm_read_word(&_table[_i]) : 0;
 }
 
-static void readmem(uint8_t _addr, uint8_t _nbytes, uint8_t __buff[])
+// Interpolated deviation for a Q0.24 fraction, in Q0.24
+static int32_t _deviation(const uint16_t *_table, uint32_t _frac)
 {
-	I2CStart(_dev_address); // start transmission to device
-	I2CWriteByte(_addr); // sends register address to read from
-	I2CStop(); // end transmission
+	uint8_t i = _frac >> 16;
+	int32_t d0 = _devAt(_table, i);
+	int32_t d1 = _devAt(_table, i + 1);
 
-	I2CStart(_dev_address | I2C_READ); // start transmission to device
-	for (uint8_t i = 0; i < _nbytes; i++) {
-		if (i == (_nbytes - 1))
-			I2CReadByte(&__buff[i], I2C_NOACK);
-		else
-			I2CReadByte(&__buff[i], I2C_ACK);
+	return (d0 << (LOG_FRAC_BITS - 19)) +
+		   ((d1 - d0) * (uint16_t)_frac >> (16 - (LOG_FRAC_BITS - 19)));
+}
+
+// log2(_x) in Q8.24, a bad reading of 0 gives 0
+static int32_t _log2(uint32_t _x)
+{
+	int8_t e = 31;
+
+	if (!_x)
+		return 0;
+	while (!(_x & 0xFF000000UL)) {
+		_x <<= 8;
+		e -= 8;
 	}
-	I2CStop();
+	while (!(_x & 0x80000000UL)) {
+		_x <<= 1;
+		e--;
+	}
+	// drop the leading one, the rest is the Q0.24 fraction
+	_x = (_x << 1) >> (32 - LOG_FRAC_BITS);
+	return ((int32_t)e << LOG_FRAC_BITS) + _x + _deviation(_log2Dev, _x);
+}
+
+// 2^_y rounded to an integer, _y is Q8.24 in 0..31
+static uint32_t _exp2(int32_t _y)
+{
+	uint8_t n = _y >> LOG_FRAC_BITS;
+	uint32_t f = _y & ((1UL << LOG_FRAC_BITS) - 1);
+	uint32_t m = (1UL << LOG_FRAC_BITS) + f - _deviation(_exp2Dev, f);
+
+	if (n >= LOG_FRAC_BITS)
+		return m << (n - LOG_FRAC_BITS);
+	return (m + (1UL << (LOG_FRAC_BITS - 1 - n))) >> (LOG_FRAC_BITS - n);
+}
+
+/*
+ * Altitude 44330m * (1 - (p / p0) ^ 0.1903) as a function of
+ * u = log2(p / p0), which bends much less than the plain ratio.
+ * ALT_TABLE_SIZE points 1/32 apart from u = -2 (p / p0 = 0.25, that
+ * is 300..1100 hPa for p0 of 880..1200 hPa) up to 0.5, each raised
+ * by half the chord sag. With the interpolation and the log2() errors
+ * the result is within 8 cm of the float formula, outside of the
+ * range the log domain formula is used: within 12 cm, 30 cm with the
+ * 740 Pa datum of main.c, 45..71 km above every reading there.
+ * tools/bmp085test.c checks these bounds, "make test" runs it.
+ */
+#define ALT_TABLE_SIZE				81
+#define ALT_TABLE_MIN				(-2L << LOG_FRAC_BITS)
+#define ALT_TABLE_SHIFT				(LOG_FRAC_BITS - 5)		// 1/32 steps
+
+static const int32_t _altTable[ALT_TABLE_SIZE] PROGMEM = {
+	 1027936,  1013871,   999748,   985567,   971327,   957029,
+	  942671,   928254,   913777,   899241,   884644,   869988,
+	  855270,   840492,   825653,   810753,   795791,   780767,
+	  765681,   750533,   735323,   720049,   704713,   689313,
+	  673849,   658322,   642730,   627074,   611354,   595568,
+	  579717,   563801,   547819,   531771,   515657,   499476,
+	  483228,   466913,   450531,   434081,   417563,   400977,
+	  384323,   367600,   350807,   333945,   317014,   300013,
+	  282941,   265799,   248586,   231302,   213947,   196520,
+	  179021,   161449,   143805,   126088,   108298,    90435,
+	   72498,    54486,    36401,    18240,        5,   -18306,
+	  -36692,   -55155,   -73693,   -92309,  -111001,  -129770,
+	 -148617,  -167542,  -186544,  -205626,  -224786,  -244025,
+	 -263344,  -282743,  -302221,
+};
+
+/*
+ * _a * _k for a Q8.24 _k, in 16x16 bit pieces to stay in 32 bits.
+ * The fractions of the pieces are added up before rounding once.
+ */
+static int32_t _mulQ24(int32_t _a, uint32_t _k)
+{
+	uint8_t neg = _a < 0;
+	uint32_t u = neg ? -_a : _a;
+	uint16_t uh = u >> 16, ul = u, kh = _k >> 16, kl = _k;
+	uint32_t hl = (uint32_t)uh * kl, lh = (uint32_t)ul * kh;
+
+	u = (uint8_t)hl + (uint8_t)lh + ((uint32_t)ul * kl >> 16) + 0x80;	// 1/256
+	u = ((uint32_t)uh * kh << 8) + (hl >> 8) + (lh >> 8) + (u >> 8);
+	return neg ? -(int32_t)u : (int32_t)u;
+}
+
+static uint8_t writemem(uint8_t _addr, uint8_t _val)
+{
+	uint8_t buf[2] = { _addr, _val };	// register address, value to write
+
+	return I2CWriteBuf(_dev_address, buf, sizeof(buf));
+}
+
+static uint8_t readmem(uint8_t _addr, uint8_t _nbytes, uint8_t __buff[])
+{
+	// register address, then repeated start and burst read
+	return I2CWriteThenRead(_dev_address, &_addr, 1, __buff, _nbytes);
 }
 
 static uint8_t getDevAddr(void)
@@ -119,55 +342,82 @@ static void setMode(uint8_t _BMPMode)
 	_oss = _BMPMode;
 }
 
-static void calcTrueTemperature()
+/*
+ * Conversions run in the chip while the caller does something else:
+ * startConversion() kicks one off, conversionDone() tells when the
+ * datasheet max conversion time for the mode has passed (or EOC went
+ * high, when wired) and readConversion() fetches the raw result.
+ */
+static uint8_t startConversion(uint8_t _what)
 {
-	long ut,x1,x2;
+	uint8_t cmd;
+
+	_conv = BMP085_CONV_NONE;
+	if (_sample != SAMPLE_OFF)
+		return EI2CBUSY;
+	if (!I2CPresent(_dev_address))
+		return EI2CNODEV;
+	if (!_calValid && getCalData() != ESUCCESS)
+		return EBMPCALDATA;
+
+	if (_what == BMP085_CONV_TEMPERATURE) {
+		cmd = READ_TEMPERATURE;
+		_convUs = CONV_TEMPERATURE_US;
+	} else {
+		cmd = READ_PRESSURE + (_oss << 6);
+		_convUs = _convPressureUs[_oss];
+	}
+	if (writemem(CONTROL, cmd) != ESUCCESS)
+		return EI2CWRITE;
+	_conv = _what;
+	_convStart = micros();
 
-	//read Raw Temperature
-	writemem(CONTROL, READ_TEMPERATURE);
-	_delay_ms(5);                                         // min. 4.5ms read Temp delay
-	readmem(CONTROL_OUTPUT, 2, _buff);
-	ut = (long)((_buff[0] << 8) + _buff[1]);    // uncompensated temperature value
+	return ESUCCESS;
+}
+
+// Nothing running counts as done, readConversion() tells it apart
+static uint8_t conversionDone(void)
+{
+	if (_conv == BMP085_CONV_NONE)
+		return 1;
+#ifdef BMP085_EOC_PIN
+	if (BMP085_EOC_PIN & _BV(BMP085_EOC_BIT))
+		return 1;
+#endif
+	return micros() - _convStart >= _convUs;
+}
+
+static uint8_t readConversion(uint8_t _what, uint8_t _nbytes)
+{
+	if (_conv != _what)
+		return EBMPNOCONV;
+	if (!conversionDone())
+		return EI2CBUSY;
+	_conv = BMP085_CONV_NONE;
+	if (readmem(CONTROL_OUTPUT, _nbytes, _buff) != ESUCCESS)
+		return EI2CREAD;
+
+	return ESUCCESS;
+}
+
+// b5 from an uncompensated temperature value
+static long compensateTemperature(long ut)
+{
+	long x1,x2;
 
-	// calculate temperature
 	x1 = ((ut - ac6) * ac5 >> 15);
 	x2 = ((long)mc << 11) / (x1 + md);
-	b5 = x1 + x2;
+	return x1 + x2;
 }
 
-static void calcTruePressure(long *_TruePressure)
+// True pressure in Pa from an uncompensated pressure value and b5
+static long compensatePressure(long up, long _b5)
 {
-	long up,x1,x2,x3,b3,b6,p;
+	long x1,x2,x3,b3,b6,p;
 	unsigned long b4,b7;
 	int32_t tmp;
 
-#if AUTO_UPDATE_TEMPERATURE
-	calcTrueTemperature();        // b5 update
-#endif
-
-	//read Raw Pressure
-	writemem(CONTROL, READ_PRESSURE+(_oss << 6));
-
-	switch (_oss) {
-		case 0:
-			_delay_ms(5);
-			break;
-		case 1:
-			_delay_ms(8);
-			break;
-		case 2:
-			_delay_ms(14);
-			break;
-		case 3:
-			_delay_ms(26);
-			break;
-	}
-
-	readmem(CONTROL_OUTPUT, 3, _buff);
-	up = ((((long)_buff[0] <<16) | ((long)_buff[1] <<8) | ((long)_buff[2])) >> (8-_oss)); // uncompensated pressure value
-
-	// calculate true pressure
-	b6 = b5 - 4000;             // b5 is updated by calcTrueTemperature().
+	b6 = _b5 - 4000;
 	x1 = (b2* (b6 * b6 >> 12)) >> 11;
 	x2 = ac2 * b6 >> 11;
 	x3 = x1 + x2;
@@ -183,51 +433,384 @@ static void calcTruePressure(long *_TruePressure)
 	x1 = (p >> 8) * (p >> 8);
 	x1 = (x1 * 3038) >> 16;
 	x2 = (-7357 * p) >> 16;
-	*_TruePressure = p + ((x1 + x2 + 3791) >> 4);
+	return p + ((x1 + x2 + 3791) >> 4);
+}
+
+static uint8_t readTemperature(void)
+{
+	long ut;
+	uint8_t rv;
+
+	if ((rv = readConversion(BMP085_CONV_TEMPERATURE, 2)) != ESUCCESS)
+		return rv;
+	ut = (long)((_buff[0] << 8) + _buff[1]);    // uncompensated temperature value
+	b5 = compensateTemperature(ut);
+
+	return ESUCCESS;
+}
+
+static uint8_t readPressure(long *_TruePressure)
+{
+	long up;
+	uint8_t rv;
+
+	if ((rv = readConversion(BMP085_CONV_PRESSURE, 3)) != ESUCCESS)
+		return rv;
+	up = ((((long)_buff[0] <<16) | ((long)_buff[1] <<8) | ((long)_buff[2])) >> (8-_oss)); // uncompensated pressure value
+	*_TruePressure = compensatePressure(up, b5);    // b5 is updated by readTemperature().
+
+	return ESUCCESS;
+}
+
+static uint8_t calcTrueTemperature(void)
+{
+	uint8_t rv;
+
+	if ((rv = startConversion(BMP085_CONV_TEMPERATURE)) != ESUCCESS)
+		return rv;
+	while (!conversionDone())
+		;
+	return readTemperature();
+}
+
+static uint8_t calcTruePressure(long *_TruePressure)
+{
+	uint8_t rv;
+
+#if AUTO_UPDATE_TEMPERATURE
+	if (calcTrueTemperature() != ESUCCESS)        // b5 update
+		return EI2CWRITE;
+#endif
+
+	if ((rv = startConversion(BMP085_CONV_PRESSURE)) != ESUCCESS)
+		return rv;
+	while (!conversionDone())
+		;
+	return readPressure(_TruePressure);
+}
+
+// Altitude in cm for a Q8.24 log2(p / p0)
+static int32_t altitude(int32_t _u)
+{
+	uint32_t d = _u - ALT_TABLE_MIN;
+	uint8_t i = d >> ALT_TABLE_SHIFT;
+	int32_t a0, a1;
+
+	if (_u < ALT_TABLE_MIN || (d >> ALT_TABLE_SHIFT) >= ALT_TABLE_SIZE - 1)
+		return ALT_SCALE - (int32_t)_exp2(_log2(ALT_SCALE) +
+										  _mulQ24(_u, POW_EXP_ALTITUDE));
+
+	a0 = pgm_read_dword(&_altTable[i]);
+	a1 = pgm_read_dword(&_altTable[i + 1]);
+	// 16 bits of the step are plenty and keep the product in 32 bits
+	return a0 + (((a1 - a0) * (int32_t)((d >> (ALT_TABLE_SHIFT - 16)) & 0xFFFF)) >> 16);
+}
+
+/*
+ * Sea level reduction factor 1 / (1 - h / 44330m) ^ 5.255 in Q8.24,
+ * recomputed only when the reference altitude changes
+ */
+static void updateReduction(void)
+{
+	_reduction = _exp2(((int32_t)LOG_FRAC_BITS << LOG_FRAC_BITS) -
+					   _mulQ24(_log2(ALT_SCALE - _param_centimeters) - _log2(ALT_SCALE),
+							   POW_EXP_PRESSURE));
+}
+
+static int32_t reducePressure(long _TruePressure)
+{
+	return _mulQ24(_TruePressure, _reduction) + _Pa_Offset;
 }
 
-static void getPressure(int32_t *_Pa)
+// On a bus error the outputs below are left untouched
+static uint8_t getPressure(int32_t *_Pa)
 {
 	long TruePressure;
+	uint8_t err;
 
-	calcTruePressure(&TruePressure);
-	*_Pa = TruePressure / pow((1 - (float)_param_centimeters / 4433000), 5.255) + _Pa_Offset;
-	// converting from float to int32_t truncates toward zero, 1010.999985 becomes 1010 resulting in 1 Pa error (max).
+	if ((err = calcTruePressure(&TruePressure)) != ESUCCESS)
+		return err;
+	*_Pa = reducePressure(TruePressure);
 	// Note that BMP085 abs accuracy from 700...1100hPa and 0..+65C is +-100Pa (typ.)
+
+	return ESUCCESS;
 }
 
 static void getTemperature(long *_Temperature)
 {
-	getCalData();
-	calcTrueTemperature();                            // force b5 update
+	if (calcTrueTemperature() != ESUCCESS)            // force b5 update
+		return;
 	*_Temperature = (b5 + 8) >> 4;
 }
 
-static void getAltitude(int32_t *_centimeters)
+// Results of startConversion(), EI2CBUSY until conversionDone()
+static uint8_t collectTemperature(long *_Temperature)
+{
+	uint8_t rv;
+
+	if ((rv = readTemperature()) == ESUCCESS)
+		*_Temperature = (b5 + 8) >> 4;
+	return rv;
+}
+
+// Compensated with the temperature collected last
+static uint8_t collectPressure(int32_t *_Pa)
 {
 	long TruePressure;
+	uint8_t rv;
 
-	calcTruePressure(&TruePressure);
-	*_centimeters =  4433000 * (1 - pow((TruePressure / (float)_param_datum), 0.1903)) + _cm_Offset;
-	// converting from float to int32_t truncates toward zero, 100.999985 becomes 100 resulting in 1 cm error (max).
+	if ((rv = readPressure(&TruePressure)) == ESUCCESS)
+		*_Pa = reducePressure(TruePressure);
+	return rv;
 }
 
-static void setLocalPressure(int32_t _Pa)
+/*
+ * Temperature and pressure from one UT + UP cycle, non-blocking:
+ * call it until it stops returning EI2CBUSY. In dynamic mode
+ * (datasheet p. 10) a temperature younger than _tempMs is reused
+ * and the cycle is a single pressure conversion.
+ */
+static uint8_t measure(long *_Temperature, int32_t *_Pa)
 {
+	long TruePressure;
+	uint8_t rv;
+
+	if (!conversionDone())
+		return EI2CBUSY;
+
+	switch (_meas) {
+	case BMP085_CONV_NONE:
+		if (_tempValid && millis() - _tempTime < _tempMs)
+			_meas = BMP085_CONV_PRESSURE;
+		else
+			_meas = BMP085_CONV_TEMPERATURE;
+		rv = startConversion(_meas);
+		break;
+	case BMP085_CONV_TEMPERATURE:
+		if ((rv = readTemperature()) != ESUCCESS)
+			break;
+		_tempValid = 1;
+		_tempTime = millis();
+		_meas = BMP085_CONV_PRESSURE;
+		rv = startConversion(_meas);
+		break;
+	default:
+		_meas = BMP085_CONV_NONE;
+		if ((rv = readPressure(&TruePressure)) != ESUCCESS)
+			return rv;
+		*_Temperature = (b5 + 8) >> 4;
+		*_Pa = reducePressure(TruePressure);
+		return ESUCCESS;
+	}
+
+	if (rv != ESUCCESS) {
+		_meas = BMP085_CONV_NONE;
+		return rv;
+	}
+	return EI2CBUSY;
+}
+
+static void setTemperatureInterval(uint16_t _ms)
+{
+	_tempMs = _ms;
+}
+
+/*
+ * Background sampling: back to back conversions run from the timer
+ * tick through the I2C engine, pressure all the time and temperature
+ * every SAMPLE_TEMP_MS (the datasheet dynamic mode). The raw pressure
+ * values are summed and every _decimation of them make one output,
+ * a boxcar (first order CIC) decimator like the oversampling done
+ * in the chip. The average is compensated in readSampled(), out of
+ * the interrupt context.
+ */
+static void _sampleStarted(struct I2CXfer *xfer)
+{
+	_sampleStart = micros();
+}
+
+static void _sampleTick(void)
+{
+	long raw;
+	uint8_t cmd;
+
+	// Time out a hung transfer, nothing else might poll the bus
+	I2CPoll();
+	if (_sample == SAMPLE_OFF || _sampleXfer.status == EI2CBUSY)
+		return;
+
+	switch (_sample) {
+	case SAMPLE_START:
+		if (_sampleXfer.status != ESUCCESS)
+			break;
+		_sample = SAMPLE_CONV;
+		return;
+	case SAMPLE_CONV:
+		if (micros() - _sampleStart < (_sampleConv == BMP085_CONV_TEMPERATURE ?
+				CONV_TEMPERATURE_US : _convPressureUs[_oss]))
+			return;
+		_sampleCmd[0] = CONTROL_OUTPUT;
+		_sampleXfer.wlen = 1;
+		_sampleXfer.rlen = (_sampleConv == BMP085_CONV_TEMPERATURE) ? 2 : 3;
+		_sampleXfer.done = NULL;
+		_sample = SAMPLE_READ;
+		I2CSubmit(&_sampleXfer);
+		return;
+	case SAMPLE_READ:
+		if (_sampleXfer.status != ESUCCESS)
+			break;
+		if (_sampleConv == BMP085_CONV_TEMPERATURE) {
+			b5 = compensateTemperature((long)((_sampleBuf[0] << 8) + _sampleBuf[1]));
+			_sampleTemp = millis();
+			_sampleHasTemp = 1;
+			break;
+		}
+		raw = (((long)_sampleBuf[0] << 16) | ((long)_sampleBuf[1] << 8) |
+			   _sampleBuf[2]) >> (8 - _oss);
+		_upSum += raw;
+		if (++_count >= _decimation) {
+			_outSum = _upSum;
+			_outB5 = b5;
+			_outReady = 1;
+			_upSum = 0;
+			_count = 0;
+		}
+		break;
+	default:
+		break;
+	}
+
+	// Start the next conversion
+	if (!I2CPresent(_dev_address)) {
+		_sample = SAMPLE_IDLE;
+		return;
+	}
+	if (!_sampleHasTemp || millis() - _sampleTemp >= SAMPLE_TEMP_MS) {
+		_sampleConv = BMP085_CONV_TEMPERATURE;
+		cmd = READ_TEMPERATURE;
+	} else {
+		_sampleConv = BMP085_CONV_PRESSURE;
+		cmd = READ_PRESSURE + (_oss << 6);
+	}
+	_sampleCmd[0] = CONTROL;
+	_sampleCmd[1] = cmd;
+	_sampleXfer.wlen = 2;
+	_sampleXfer.rlen = 0;
+	_sampleXfer.done = _sampleStarted;
+	_sample = SAMPLE_START;
+	I2CSubmit(&_sampleXfer);
+}
+
+/*
+ * Sample in the background, an output every _dec pressure
+ * conversions. The blocking and step-wise calls return EI2CBUSY
+ * until stopSampling().
+ */
+static uint8_t startSampling(uint8_t _dec)
+{
+	if (!_dec)
+		return ENULLPOINTER;
+	stopSampling();
+	if (!I2CPresent(_dev_address))
+		return EI2CNODEV;
+	if (!_calValid && getCalData() != ESUCCESS)
+		return EBMPCALDATA;
+
+	_sampleXfer.addr = _dev_address;
+	_sampleXfer.flags = 0;
+	_sampleXfer.wbuf = _sampleCmd;
+	_sampleXfer.rbuf = _sampleBuf;
+	_decimation = _dec;
+	_count = 0;
+	_upSum = 0;
+	_outReady = 0;
+	_sampleHasTemp = 0;
+	if (!tmr_add_tick(_sampleTick))
+		return ETMRNOSLOT;
+	_sample = SAMPLE_IDLE;
+
+	return ESUCCESS;
+}
+
+static void stopSampling(void)
+{
+	_sample = SAMPLE_OFF;
+	// the tick doesn't touch a stopped sampler, let the last transfer end
+	while (_sampleXfer.status == EI2CBUSY)
+		;
+}
+
+// Last sampler output, EI2CBUSY if there is no new one yet
+static uint8_t readSampled(long *_Temperature, int32_t *_Pa)
+{
+	uint32_t sum;
+	long t5;
+	uint8_t oldSREG = SREG;
+
+	cli();
+	if (!_outReady) {
+		SREG = oldSREG;
+		return EI2CBUSY;
+	}
+	sum = _outSum;
+	t5 = _outB5;
+	_outReady = 0;
+	SREG = oldSREG;
+
+	*_Temperature = (t5 + 8) >> 4;
+	*_Pa = reducePressure(compensatePressure((sum + _decimation / 2) / _decimation, t5));
+
+	return ESUCCESS;
+}
+
+static uint8_t getAltitude(int32_t *_centimeters)
+{
+	long TruePressure;
+	uint8_t err;
+
+	if ((err = calcTruePressure(&TruePressure)) != ESUCCESS)
+		return err;
+	*_centimeters = altitude(_log2(TruePressure) - _log2(_param_datum)) + _cm_Offset;
+
+	return ESUCCESS;
+}
+
+// The reference is set from a measurement, on error the previous one is kept
+static uint8_t setLocalPressure(int32_t _Pa)
+{
+	int32_t old_datum = _param_datum;
 	int32_t tmp_alt;
+	uint8_t err;
 
 	_param_datum = _Pa;
-	getAltitude(&tmp_alt);    // calc altitude based on current pressure
+	err = getAltitude(&tmp_alt);    // calc altitude based on current pressure
+	if (err != ESUCCESS) {
+		_param_datum = old_datum;
+		return err;
+	}
 	_param_centimeters = tmp_alt;
+	updateReduction();
+
+	return ESUCCESS;
 }
 
-static void setLocalAbsAlt(int32_t _centimeters)
+static uint8_t setLocalAbsAlt(int32_t _centimeters)
 {
+	int32_t old_centimeters = _param_centimeters;
 	int32_t tmp_Pa;
+	uint8_t err;
 
 	_param_centimeters = _centimeters;
-	getPressure(&tmp_Pa);    // calc pressure based on current altitude
+	updateReduction();
+	err = getPressure(&tmp_Pa);    // calc pressure based on current altitude
+	if (err != ESUCCESS) {
+		_param_centimeters = old_centimeters;
+		updateReduction();
+		return err;
+	}
 	_param_datum = tmp_Pa;
+
+	return ESUCCESS;
 }
 
 static void setAltOffset(int32_t _centimeters)
@@ -246,29 +829,40 @@ static void zeroCal(int32_t _Pa, int32_t _centimeters)
 	setPaOffset(_Pa - _param_datum);
 }
 
-static void getCalData(void) {
-	readmem(CAL_AC1, 2, _buff);
-	ac1 = ((int16_t)_buff[0] << 8 | ((int16_t)_buff[1]));
-	readmem(CAL_AC2, 2, _buff);
-	ac2 = ((int16_t)_buff[0] << 8 | ((int16_t)_buff[1]));
-	readmem(CAL_AC3, 2, _buff);
-	ac3 = ((int16_t)_buff[0] << 8 | ((int16_t)_buff[1]));
-	readmem(CAL_AC4, 2, _buff);
-	ac4 = ((uint16_t)_buff[0] << 8 | ((uint16_t)_buff[1]));
-	readmem(CAL_AC5, 2, _buff);
-	ac5 = ((uint16_t)_buff[0] << 8 | ((uint16_t)_buff[1]));
-	readmem(CAL_AC6, 2, _buff);
-	ac6 = ((uint16_t)_buff[0] << 8 | ((uint16_t)_buff[1]));
-	readmem(CAL_B1, 2, _buff);
-	b1 = ((int16_t)_buff[0] << 8 | ((int16_t)_buff[1]));
-	readmem(CAL_B2, 2, _buff);
-	b2 = ((int16_t)_buff[0] << 8 | ((int16_t)_buff[1]));
-	readmem(CAL_MB, 2, _buff);
-	mb = ((int16_t)_buff[0] << 8 | ((int16_t)_buff[1]));
-	readmem(CAL_MC, 2, _buff);
-	mc = ((int16_t)_buff[0] << 8 | ((int16_t)_buff[1]));
-	readmem(CAL_MD, 2, _buff);
-	md = ((int16_t)_buff[0] << 8 | ((int16_t)_buff[1]));
+/*
+ * The calibration words are constants of the chip, they are read
+ * once in a single burst. A word of 0x0000 or 0xFFFF means the
+ * EEPROM or the read went wrong, the block is read again on the
+ * next measurement then.
+ */
+static uint8_t getCalData(void)
+{
+	uint8_t buf[CAL_SIZE];
+	uint16_t w[CAL_SIZE / 2];
+	uint8_t i;
+
+	_calValid = 0;
+	if (readmem(CAL_AC1, CAL_SIZE, buf) != ESUCCESS)
+		return EI2CREAD;
+	for (i = 0; i < CAL_SIZE / 2; i++) {
+		w[i] = (uint16_t)buf[2 * i] << 8 | buf[2 * i + 1];
+		if (w[i] == 0x0000 || w[i] == 0xFFFF)
+			return EBMPCALDATA;
+	}
+	ac1 = w[0];
+	ac2 = w[1];
+	ac3 = w[2];
+	ac4 = w[3];
+	ac5 = w[4];
+	ac6 = w[5];
+	b1 = w[6];
+	b2 = w[7];
+	mb = w[8];
+	mc = w[9];
+	md = w[10];
+	_calValid = 1;
+
+	return ESUCCESS;
 }
 
 static struct BMP085 sensor = {
@@ -284,22 +878,44 @@ static struct BMP085 sensor = {
 	.getTemperature = getTemperature,
 	.calcTrueTemperature = calcTrueTemperature,
 	.calcTruePressure = calcTruePressure,
+	.startConversion = startConversion,
+	.conversionDone = conversionDone,
+	.collectTemperature = collectTemperature,
+	.collectPressure = collectPressure,
+	.measure = measure,
+	.setTemperatureInterval = setTemperatureInterval,
+	.startSampling = startSampling,
+	.stopSampling = stopSampling,
+	.readSampled = readSampled,
 	.writeMem = writemem,
 	.readMem = readmem,
 };
 
-struct BMP085 *BMP085_init(uint8_t _BMPMode, int32_t _initVal, uint8_t _Unitmeters)
+/*
+ * The driver is returned even if the sensor did not answer, *_err
+ * tells whether it was set up. Call it again once the sensor is back.
+ */
+struct BMP085 *BMP085_init(uint8_t _BMPMode, int32_t _initVal, uint8_t _Unitmeters,
+						   uint8_t *_err)
 {
+	uint8_t err;
 
 	_dev_address = BMP085_ADDR;
+	I2CSetSpeed(_dev_address, BMP085_I2C_SPEED);
+	I2CSetPriority(_dev_address, I2C_PRIO_SENSOR);
 	_cm_Offset = 0;
 	_Pa_Offset = 0;						// 1hPa = 100Pa = 1mbar
 
-	oldEMA = 0;
-	getCalData();						// initialize cal data
-	calcTrueTemperature();				// initialize b5
+	stopSampling();
+	_conv = BMP085_CONV_NONE;
+	_meas = BMP085_CONV_NONE;
+	_tempValid = 0;
 	setMode(_BMPMode);
-	_Unitmeters ? setLocalAbsAlt(_initVal) : setLocalPressure(_initVal);
+	// initialize cal data and b5, then the reference
+	if ((err = getCalData()) == ESUCCESS &&
+		(err = calcTrueTemperature()) == ESUCCESS)
+		err = _Unitmeters ? setLocalAbsAlt(_initVal) : setLocalPressure(_initVal);
+	*_err = err;
 
 	return &sensor;
 }
@@ -32,6 +32,7 @@
 #define _BMP085_H_
 
 #define BMP085_ADDR					0xEE	//0x77 default I2C address
+#define BMP085_I2C_SPEED			400000UL	// max SCL rate, Hz
 
 // BMP085 Modes
 #define MODE_ULTRA_LOW_POWER		0 //oversampling=0, internalsamples=1, maxconvtimepressure=4.5ms, avgcurrent=3uA, RMSnoise_hPA=0.06, RMSnoise_m=0.5
@@ -43,7 +44,21 @@
 				// once per second and to use this value for all pressure measurements during period."
 				// (from BMP085 datasheet Rev1.2 page 10).
 				// To use dynamic measurement set AUTO_UPDATE_TEMPERATURE to false and
-				// call calcTrueTemperature() from your code.
+				// call calcTrueTemperature() from your code, or call measure() after
+				// setTemperatureInterval(1000).
+
+// Conversions, see startConversion()
+#define BMP085_CONV_NONE			0
+#define BMP085_CONV_TEMPERATURE		1
+#define BMP085_CONV_PRESSURE		2
+
+/*
+ * EOC goes high when a conversion is done. It is not wired on this
+ * board, define the input register and bit to poll it instead of
+ * waiting out the max conversion time.
+ */
+//#define BMP085_EOC_PIN			PIND
+//#define BMP085_EOC_BIT			PD4
 
 struct BMP085 {
 	uint8_t (*getAddress)(void);
@@ -51,22 +66,35 @@ struct BMP085 {
 	uint8_t (*getMode)(void);
 	void (*setMode)(uint8_t _BMPMode);						// BMP085 mode
 	// Initialization
-	void (*setLocalPressure)(int32_t _Pa);					// set known barometric pressure as reference Ex. QNH
-	void (*setLocalAbsAlt)(int32_t _centimeters);			// set known altitude as reference
+	uint8_t (*setLocalPressure)(int32_t _Pa);				// set known barometric pressure as reference Ex. QNH
+	uint8_t (*setLocalAbsAlt)(int32_t _centimeters);		// set known altitude as reference
 	void (*setAltOffset)(int32_t _centimeters);				// altitude offset
 	void (*setPaOffset)(int32_t _Pa);						// pressure offset
 	void (*zeroCal)(int32_t _Pa, int32_t _centimeters);		// zero Calibrate output to a specific Pa/altitude
 	// BMP sensors
-	void (*getPressure)(int32_t *_Pa);						// pressure in Pa + offset
-	void (*getAltitude)(int32_t *_centimeters);				// altitude in centimeters + offset
+	uint8_t (*getPressure)(int32_t *_Pa);					// pressure in Pa + offset
+	uint8_t (*getAltitude)(int32_t *_centimeters);			// altitude in centimeters + offset
 	void (*getTemperature)(long *_Temperature);			// temperature in C
-	void (*calcTrueTemperature)(void);						// calc temperature data b5 (only needed if AUTO_UPDATE_TEMPERATURE is false)
-	void (*calcTruePressure)(long *_TruePressure);			// calc Pressure in Pa
+	uint8_t (*calcTrueTemperature)(void);					// calc temperature data b5 (only needed if AUTO_UPDATE_TEMPERATURE is false)
+	uint8_t (*calcTruePressure)(long *_TruePressure);		// calc Pressure in Pa
+	// Non-blocking conversions: start one, do something else until it is done, collect it
+	uint8_t (*startConversion)(uint8_t _what);				// BMP085_CONV_TEMPERATURE or _PRESSURE
+	uint8_t (*conversionDone)(void);						// 1 when the result can be collected
+	uint8_t (*collectTemperature)(long *_Temperature);		// temperature in 0.1 C
+	uint8_t (*collectPressure)(int32_t *_Pa);				// pressure in Pa + offset
+	// Both from one UT + UP cycle, EI2CBUSY until done, call it again then
+	uint8_t (*measure)(long *_Temperature, int32_t *_Pa);
+	void (*setTemperatureInterval)(uint16_t _ms);			// dynamic mode, reuse temperature for _ms
+	// Background sampling from the timer tick, an output averaged over _dec pressure samples
+	uint8_t (*startSampling)(uint8_t _dec);
+	void (*stopSampling)(void);
+	uint8_t (*readSampled)(long *_Temperature, int32_t *_Pa);	// EI2CBUSY until a new output
 	// Dummy staff
-	void (*writeMem)(uint8_t _addr, uint8_t _val);
-	void (*readMem)(uint8_t _addr, uint8_t _nbytes, uint8_t __buff[]);
+	uint8_t (*writeMem)(uint8_t _addr, uint8_t _val);
+	uint8_t (*readMem)(uint8_t _addr, uint8_t _nbytes, uint8_t __buff[]);
 };
 
-struct BMP085 *BMP085_init(uint8_t _BMPMode, int32_t _initVal, uint8_t _centimeters);
+struct BMP085 *BMP085_init(uint8_t _BMPMode, int32_t _initVal, uint8_t _centimeters,
+						   uint8_t *_err);
 
 #endif /* _BMP085_H_ */
@@ -1,15 +1,21 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include "dht22.h"
+#include "timer.h"
 	
 // This should be 40, but the sensor is adding an extra bit at the start
 #define DHT22_DATA_BIT_COUNT 41
+// The sensor needs this much time between two readings
+#define DHT22_MIN_INTERVAL_MS	2000
+
+static unsigned long _lastRead;
+static uint8_t _wasRead;
 
 //
 // Read the 40 bit data stream from the DHT 22
 // Store the results in private member data to be read by public member functions
 //
-int dht22_read(float *temperature, float *humidity) {
+int dht22_read(int16_t *temperature, uint16_t *humidity) {
 	// uint8_t bitmask = _bitmask;
 	//volatile uint8_t *reg asm("r30") = _baseReg;
 	uint8_t retryCount;
@@ -19,6 +25,11 @@ int dht22_read(float *temperature, float *humidity) {
 	uint8_t checkSum, csPart1, csPart2, csPart3, csPart4;
 	int i;
 
+	if (_wasRead && (millis() - _lastRead) < DHT22_MIN_INTERVAL_MS)
+		return DHT_ERROR_TOOQUICK;
+	_wasRead = 1;
+	_lastRead = millis();
+
 	currentHumidity = 0;
 	currentTemperature = 0;
 	checkSum = 0;
@@ -117,26 +128,23 @@ int dht22_read(float *temperature, float *humidity) {
 			checkSum |= (1 << (7 - i));
 	}
 
-	*humidity = ((float)(currentHumidity & 0x7FFF)) / 10.0;
-	
-	if(currentTemperature & 0x8000) {
-		// Below zero, non standard way of encoding negative numbers!
-		currentTemperature &= 0x7FFF;
-		*temperature = ((float)currentTemperature / 10.0) * -1.0;
-	} else {
-		*temperature = (float)currentTemperature / 10.0;
-	}
-
 	csPart1 = currentHumidity >> 8;
 	csPart2 = currentHumidity & 0xFF;
 	csPart3 = currentTemperature >> 8;
 	csPart4 = currentTemperature & 0xFF;
 	
-	if (checkSum == ((csPart1 + csPart2 + csPart3 + csPart4) & 0xFF)) {
-		//*humidity = 10;
-		return DHT_ERROR_NONE;
+	if (checkSum != ((csPart1 + csPart2 + csPart3 + csPart4) & 0xFF))
+		return DHT_ERROR_CHECKSUM;
+
+	// The sensor sends both values in tenths already
+	*humidity = currentHumidity & 0x7FFF;
+	
+	if(currentTemperature & 0x8000) {
+		// Below zero, non standard way of encoding negative numbers!
+		*temperature = -(currentTemperature & 0x7FFF);
+	} else {
+		*temperature = currentTemperature;
 	}
 
-	//*humidity = 20;
-	return DHT_ERROR_CHECKSUM;
+	return DHT_ERROR_NONE;
 }
@@ -28,6 +28,7 @@ typedef enum
 } DHT22_ERROR_t;
 
 
-int dht22_read(float *temperature, float *humidity);
+// Temperature in 0.1 C, relative humidity in 0.1 %
+int dht22_read(int16_t *temperature, uint16_t *humidity);
 
 #endif /*_DHT22_H_*/
@@ -30,10 +30,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
-#include <stdio.h>
+#include <string.h>
+#include <avr/pgmspace.h>
 #include "i2c.h"
+#include "fmt.h"
 #include "ds3231.h"
 
+// Longest text of the alarm registers
+#define DS3231_ALARM_STR_SIZE		56
+
 // timekeeping registers
 #define DS3231_TIME_CAL_ADDR        0x00
 #define DS3231_ALARM1_ADDR          0x07
@@ -96,44 +101,39 @@ static void DS3231_set(struct ts t)
 		t.year_s = t.year - 1900;
 	}
 
-	uint8_t TimeDate[7] = { t.sec, t.min, t.hour, t.wday, t.mday, t.mon, t.year_s };
+	// Register address followed by second,minute,hour,dow,day,month,year
+	uint8_t TimeDate[8] = { DS3231_TIME_CAL_ADDR, t.sec, t.min, t.hour,
+							t.wday, t.mday, t.mon, t.year_s };
 
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(DS3231_TIME_CAL_ADDR);
-	for (i = 0; i <= 6; i++) {
+	for (i = 1; i <= 7; i++) {
 		TimeDate[i] = dectobcd(TimeDate[i]);
-		if (i == 5)
-			TimeDate[5] += century;
-		I2CWriteByte(TimeDate[i]);
+		if (i == 6)
+			TimeDate[6] += century;
 	}
-	I2CStop();
+	I2CWriteBuf(DS3231_I2C_ADDR, TimeDate, sizeof(TimeDate));
 }
 
 static void DS3231_get(struct ts *t)
 {
 	uint8_t TimeDate[7];			//second,minute,hour,dow,day,month,year
+	const uint8_t reg = DS3231_TIME_CAL_ADDR;
 	uint8_t century = 0;
-	uint8_t i, n;
+	uint8_t i;
 	uint16_t year_full;
 
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(DS3231_TIME_CAL_ADDR);
-	I2CStop();
+	if (!I2CPresent(DS3231_I2C_ADDR))
+		return;
+	// Keep the last good time if the RTC does not answer
+	if (I2CWriteThenRead(DS3231_I2C_ADDR, &reg, 1, TimeDate, sizeof(TimeDate)))
+		return;
 
-	I2CStart(DS3231_I2C_ADDR | I2C_READ);
 	for (i = 0; i <= 6; i++) {
-		if (i == 6)
-			I2CReadByte(&n, I2C_NOACK);
-		else
-			I2CReadByte(&n, I2C_ACK);
-
 		if (i == 5) {
-			TimeDate[5] = bcdtodec(n & 0x1F);
-			century = (n & 0x80) >> 7;
+			century = (TimeDate[5] & 0x80) >> 7;
+			TimeDate[5] = bcdtodec(TimeDate[5] & 0x1F);
 		} else
-			TimeDate[i] = bcdtodec(n);
+			TimeDate[i] = bcdtodec(TimeDate[i]);
 	}
-	I2CStop();
 
 	if (century == 1)
 		year_full = 2000 + TimeDate[6];
@@ -152,23 +152,16 @@ static void DS3231_get(struct ts *t)
 
 static void DS3231_set_addr(const uint8_t addr, const uint8_t val)
 {
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(addr);
-	I2CWriteByte(val);
-	I2CStop();
+	uint8_t buf[2] = { addr, val };
+
+	I2CWriteBuf(DS3231_I2C_ADDR, buf, sizeof(buf));
 }
 
 static uint8_t DS3231_get_addr(const uint8_t addr)
 {
 	uint8_t rv;
 
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(addr);
-	I2CStop();
-
-	I2CStart(DS3231_I2C_ADDR | I2C_READ);
-	I2CReadByte(&rv, I2C_NOACK);
-	I2CStop();
+	I2CWriteThenRead(DS3231_I2C_ADDR, &addr, 1, &rv, 1);
 
 	return rv;
 }
@@ -229,20 +222,17 @@ static int8_t DS3231_get_aging(void)
 }
 
 // temperature register
-static float DS3231_get_treg(void)
+static int16_t DS3231_get_treg(void)
 {
-	float rv;
+	int16_t rv;
+	const uint8_t reg = DS3231_TEMPERATURE_ADDR;
+	uint8_t temp[2];
 	uint8_t temp_msb, temp_lsb;
 	int8_t nint;
 
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(DS3231_TEMPERATURE_ADDR);
-	I2CStop();
-
-	I2CStart(DS3231_I2C_ADDR | I2C_READ);
-	I2CReadByte(&temp_msb, I2C_ACK);
-	I2CReadByte(&temp_lsb, I2C_NOACK);
-	I2CStop();
+	I2CWriteThenRead(DS3231_I2C_ADDR, &reg, 1, temp, sizeof(temp));
+	temp_msb = temp[0];
+	temp_lsb = temp[1];
 
 	temp_lsb >>= 6;
 
@@ -251,7 +241,8 @@ static float DS3231_get_treg(void)
 	else
 		nint = temp_msb;
 
-	rv = 0.25 * temp_lsb + nint;
+	// 0.25 C steps to tenths
+	rv = (nint * 4 + temp_lsb) * 10 / 4;
 
 	return rv;
 }
@@ -262,19 +253,27 @@ static float DS3231_get_treg(void)
 static void DS3231_set_a1(const uint8_t s, const uint8_t mi, const uint8_t h, const uint8_t d, const uint8_t * flags)
 {
 	uint8_t t[4] = { s, mi, h, d };
+	uint8_t buf[5] = { DS3231_ALARM1_ADDR };
 	uint8_t i;
 
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(DS3231_ALARM1_ADDR);
-
 	for (i = 0; i <= 3; i++) {
 		if (i == 3) {
-			I2CWriteByte(dectobcd(t[3]) | (flags[3] << 7) | (flags[4] << 6));
+			buf[i + 1] = dectobcd(t[3]) | (flags[3] << 7) | (flags[4] << 6);
 		} else
-			I2CWriteByte(dectobcd(t[i]) | (flags[i] << 7));
+			buf[i + 1] = dectobcd(t[i]) | (flags[i] << 7);
 	}
 
-	I2CStop();
+	I2CWriteBuf(DS3231_I2C_ADDR, buf, sizeof(buf));
+}
+
+// "name" followed by the value and a blank
+static char *_field(char *p, const char *name, uint8_t v, uint8_t width)
+{
+	p = fmt_str_P(p, name);
+	p = fmt_uint(p, v, width, '0');
+	*p++ = ' ';
+
+	return p;
 }
 
 static void DS3231_get_a1(char *buf, const uint8_t len)
@@ -282,32 +281,36 @@ static void DS3231_get_a1(char *buf, const uint8_t len)
 	uint8_t n[4];
 	uint8_t t[4];               //second,minute,hour,day
 	uint8_t f[5];               // flags
+	const uint8_t reg = DS3231_ALARM1_ADDR;
 	uint8_t i;
+	char str[DS3231_ALARM_STR_SIZE];
+	char *p;
 
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(DS3231_ALARM1_ADDR);
-	I2CStop();
-
-	I2CStart(DS3231_I2C_ADDR | I2C_READ);
+	I2CWriteThenRead(DS3231_I2C_ADDR, &reg, 1, n, sizeof(n));
 
 	for (i = 0; i <= 3; i++) {
-		if (i == 3)
-			I2CReadByte(&n[i], I2C_NOACK);
-		else
-			I2CReadByte(&n[i], I2C_ACK);
-
 		f[i] = (n[i] & 0x80) >> 7;
 		t[i] = bcdtodec(n[i] & 0x7F);
 	}
-	I2CStop();
 
 	f[4] = (n[3] & 0x40) >> 6;
 	t[3] = bcdtodec(n[3] & 0x3F);
 
-	snprintf(buf, len,
-			 "s%02d m%02d h%02d d%02d fs%d m%d h%d d%d wm%d %d %d %d %d",
-			 t[0], t[1], t[2], t[3], f[0], f[1], f[2], f[3], f[4], n[0],
-			 n[1], n[2], n[3]);
+	// s00 m00 h00 d00 fs0 m0 h0 d0 wm0 n0 n1 n2 n3
+	p = _field(str, PSTR("s"), t[0], 2);
+	p = _field(p, PSTR("m"), t[1], 2);
+	p = _field(p, PSTR("h"), t[2], 2);
+	p = _field(p, PSTR("d"), t[3], 2);
+	p = _field(p, PSTR("fs"), f[0], 0);
+	p = _field(p, PSTR("m"), f[1], 0);
+	p = _field(p, PSTR("h"), f[2], 0);
+	p = _field(p, PSTR("d"), f[3], 0);
+	p = _field(p, PSTR("wm"), f[4], 0);
+	for (i = 0; i <= 3; i++)
+		p = _field(p, PSTR(""), n[i], 0);
+	p[-1] = '\0';
+
+	strlcpy(buf, str, len);
 }
 
 // when the alarm flag is cleared the pulldown on INT is also released
@@ -336,19 +339,17 @@ static uint8_t DS3231_triggered_a1(void)
 static void DS3231_set_a2(const uint8_t mi, const uint8_t h, const uint8_t d, const uint8_t * flags)
 {
 	uint8_t t[3] = { mi, h, d };
+	uint8_t buf[4] = { DS3231_ALARM2_ADDR };
 	uint8_t i;
 
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(DS3231_ALARM2_ADDR);
-
 	for (i = 0; i <= 2; i++) {
 		if (i == 2) {
-			I2CWriteByte(dectobcd(t[2]) | (flags[2] << 7) | (flags[3] << 6));
+			buf[i + 1] = dectobcd(t[2]) | (flags[2] << 7) | (flags[3] << 6);
 		} else
-			I2CWriteByte(dectobcd(t[i]) | (flags[i] << 7));
+			buf[i + 1] = dectobcd(t[i]) | (flags[i] << 7);
 	}
 
-	I2CStop();
+	I2CWriteBuf(DS3231_I2C_ADDR, buf, sizeof(buf));
 }
 
 static void DS3231_get_a2(char *buf, const uint8_t len)
@@ -356,31 +357,34 @@ static void DS3231_get_a2(char *buf, const uint8_t len)
 	uint8_t n[3];
 	uint8_t t[3];				//second,minute,hour,day
 	uint8_t f[4];				// flags
+	const uint8_t reg = DS3231_ALARM2_ADDR;
 	uint8_t i;
+	char str[DS3231_ALARM_STR_SIZE];
+	char *p;
 
-	I2CStart(DS3231_I2C_ADDR);
-	I2CWriteByte(DS3231_ALARM2_ADDR);
-	I2CStop();
-
-	I2CStart(DS3231_I2C_ADDR | I2C_READ);
+	I2CWriteThenRead(DS3231_I2C_ADDR, &reg, 1, n, sizeof(n));
 
 	for (i = 0; i <= 2; i++) {
-		if (i == 2)
-			I2CReadByte(&n[i], I2C_NOACK);
-		else
-			I2CReadByte(&n[i], I2C_ACK);
-
 		f[i] = (n[i] & 0x80) >> 7;
 		t[i] = bcdtodec(n[i] & 0x7F);
 	}
-	I2CStop();
 
 	f[3] = (n[2] & 0x40) >> 6;
 	t[2] = bcdtodec(n[2] & 0x3F);
 
-	snprintf(buf, len, "m%02d h%02d d%02d fm%d h%d d%d wm%d %d %d %d", t[0],
-			 t[1], t[2], f[0], f[1], f[2], f[3], n[0], n[1], n[2]);
-
+	// m00 h00 d00 fm0 h0 d0 wm0 n0 n1 n2
+	p = _field(str, PSTR("m"), t[0], 2);
+	p = _field(p, PSTR("h"), t[1], 2);
+	p = _field(p, PSTR("d"), t[2], 2);
+	p = _field(p, PSTR("fm"), f[0], 0);
+	p = _field(p, PSTR("h"), f[1], 0);
+	p = _field(p, PSTR("d"), f[2], 0);
+	p = _field(p, PSTR("wm"), f[3], 0);
+	for (i = 0; i <= 2; i++)
+		p = _field(p, PSTR(""), n[i], 0);
+	p[-1] = '\0';
+
+	strlcpy(buf, str, len);
 }
 
 // when the alarm flag is cleared the pulldown on INT is also released
@@ -416,6 +420,8 @@ static struct DS3231 rtc = {
 
 struct DS3231 *DS3231_init(const uint8_t ctrl_reg)
 {
+	I2CSetSpeed(DS3231_I2C_ADDR, DS3231_I2C_SPEED);
+	I2CSetPriority(DS3231_I2C_ADDR, I2C_PRIO_TIME);
 	DS3231_set_creg(ctrl_reg);
 
 	return &rtc;
@@ -4,6 +4,8 @@
 // i2c slave address of the DS3231 chip
 #define DS3231_I2C_ADDR				0xD0
 #define DS3231_INTCN				0x4
+// max SCL rate, Hz
+#define DS3231_I2C_SPEED			400000UL
 
 struct ts {
 	uint8_t sec;		/* seconds */
@@ -25,7 +27,7 @@ struct DS3231 {
 	void (*get)(struct ts *t);
 	void (*set_aging)(const int8_t val);
 	int8_t (*get_aging)(void);
-	float (*get_treg)(void);
+	int16_t (*get_treg)(void);		// in 0.1 C
 	void (*set_a1)(const uint8_t s, const uint8_t mi, const uint8_t h,
 				   const uint8_t d, const uint8_t *flags);
 	void (*get_a1)(char *buf, const uint8_t len);
@@ -11,6 +11,11 @@
 #define EI2CWRITE		4	// Unsuccessfull write
 #define EI2CWRITELOOP	5	// Entered endless loop while trying to write data to the device
 #define EI2CREAD		6	// Unsuccessfull read
+#define EI2CBUSY		12	// Transaction is queued or still on the bus
+#define EI2CTIMEOUT		13	// Transaction did not complete in time and was aborted
+#define EI2CNOSLOT		14	// I2C device table is full
+#define EI2CBACKOFF		15	// Device failed repeatedly and is skipped for a while
+#define EI2CNODEV		16	// Device is not on the bus, see I2CProbe()
 
 // EEPROM operation errors
 #define EEEPADDRLSB		7	// Error occured while trying to send LSB address byte to i2c EEPROM device
@@ -21,4 +26,11 @@
 // Time errors
 #define EGPSTIMENOFIX	11	// No fix, therefore we have no access to actual time
 
+// Sensor errors
+#define EBMPCALDATA		17	// BMP085 calibration block is blank or unreadable
+#define EBMPNOCONV		18	// No BMP085 conversion of this kind was started
+
+// Timer errors
+#define ETMRNOSLOT		19	// All the timer tick hooks are taken
+
 #endif /* _ERRORNO_H_ */
@@ -0,0 +1,129 @@
+#include <avr/pgmspace.h>
+#include "fmt.h"
+
+/*
+ * Digits of v, least significant first. The 32-bit division is
+ * a slow library call, so it is used while v doesn't fit 16 bits.
+ */
+static uint8_t _digits(char *d, uint32_t v)
+{
+	uint8_t n = 0;
+	uint16_t w;
+
+	while (v > 0xFFFF) {
+		d[n++] = '0' + v % 10;
+		v /= 10;
+	}
+
+	w = v;
+	do {
+		d[n++] = '0' + w % 10;
+		w /= 10;
+	} while (w);
+
+	return n;
+}
+
+static char *_number(char *p, uint32_t v, uint8_t neg,
+					 uint8_t width, char pad)
+{
+	char d[10];
+	uint8_t n = _digits(d, v);
+
+	// The sign takes a place, it goes before zeroes and after blanks
+	if (neg) {
+		if (width)
+			width--;
+		if (pad == '0')
+			*p++ = '-';
+	}
+	for (; width > n; width--)
+		*p++ = pad;
+	if (neg && pad != '0')
+		*p++ = '-';
+	while (n)
+		*p++ = d[--n];
+
+	return p;
+}
+
+char *fmt_uint(char *p, uint32_t v, uint8_t width, char pad)
+{
+	return _number(p, v, 0, width, pad);
+}
+
+char *fmt_int(char *p, int32_t v, uint8_t width, char pad)
+{
+	if (v < 0)
+		return _number(p, -(uint32_t)v, 1, width, pad);
+
+	return _number(p, v, 0, width, pad);
+}
+
+char *fmt_tenths(char *p, int32_t v, uint8_t width)
+{
+	char d[10];
+	uint32_t u = v;
+	uint8_t n;
+
+	if (v < 0) {
+		*p++ = '-';
+		u = -(uint32_t)v;
+	}
+
+	// The lowest digit is the fraction, 0.x has an integer digit too
+	n = _digits(d, u);
+	if (n == 1)
+		d[n++] = '0';
+	for (; width > n - 1; width--)
+		*p++ = '0';
+	while (n > 1)
+		*p++ = d[--n];
+	*p++ = '.';
+	*p++ = d[0];
+
+	return p;
+}
+
+char *fmt_hex(char *p, uint8_t v)
+{
+	static const char hex[16] PROGMEM = "0123456789ABCDEF";
+
+	*p++ = pgm_read_byte(&hex[v >> 4]);
+	*p++ = pgm_read_byte(&hex[v & 0x0F]);
+
+	return p;
+}
+
+char *fmt_time(char *p, uint8_t hour, uint8_t min)
+{
+	p = _number(p, hour, 0, 2, '0');
+	*p++ = ':';
+
+	return _number(p, min, 0, 2, '0');
+}
+
+char *fmt_icon(char *p, uint8_t icon)
+{
+	*p++ = icon;
+
+	return p;
+}
+
+char *fmt_str_P(char *p, const char *s)
+{
+	char c;
+
+	while ((c = pgm_read_byte(s++)))
+		*p++ = c;
+
+	return p;
+}
+
+char *fmt_strn(char *p, const char *s, uint8_t max)
+{
+	while (max-- && *s)
+		*p++ = *s++;
+
+	return p;
+}
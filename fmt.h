@@ -0,0 +1,32 @@
+#ifndef _FMT_H_
+#define _FMT_H_
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
+/*
+ * Integer formatting for the screen and USB output, a small
+ * replacement for snprintf(). Every function writes at p and
+ * returns the position after the last char written, so calls
+ * can be chained. Nothing is NUL terminated, the caller does
+ * it and makes sure the buffer is large enough. width is the
+ * minimal number of chars, longer numbers are not cut.
+ */
+char *fmt_uint(char *p, uint32_t v, uint8_t width, char pad);
+char *fmt_int(char *p, int32_t v, uint8_t width, char pad);
+// v in tenths, the integer part is zero padded to width digits: -05.3
+char *fmt_tenths(char *p, int32_t v, uint8_t width);
+// Two hex digits
+char *fmt_hex(char *p, uint8_t v);
+// hh:mm
+char *fmt_time(char *p, uint8_t hour, uint8_t min);
+// LCD icon, see main.h
+char *fmt_icon(char *p, uint8_t icon);
+// String from flash
+char *fmt_str_P(char *p, const char *s);
+// At most max chars of a string
+char *fmt_strn(char *p, const char *s, uint8_t max);
+
+#define fmt_pstr(p, s)		fmt_str_P((p), PSTR(s))
+
+#endif /* _FMT_H_ */
@@ -1,83 +1,832 @@
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <stddef.h>
 #include "i2c.h"
+#include "timer.h"
 #include "errorno.h"
 
+// TWCR value to clear TWINT and let the hardware go on, with TWI_vect enabled
+#define TWCR_GO			((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+// Time of one byte on the bus (9 SCL periods) at 100 kHz, rounded up
+#define I2C_BYTE_US		100
+#define TWPS_MASK		((1 << TWPS1) | (1 << TWPS0))
+// Fixed part of a transaction timeout, on top of I2C_BYTE_US per byte
+#define I2C_TIMEOUT_US	1000
+/*
+ * Back-off of a failing device: after I2C_BACKOFF_AFTER failures in a row
+ * its transactions fail at once with EI2CBACKOFF for I2C_BACKOFF_MS,
+ * doubled on each next failure, up to 2^I2C_BACKOFF_MAXSHIFT times.
+ */
+#define I2C_BACKOFF_AFTER		2
+#define I2C_BACKOFF_MS			50
+#define I2C_BACKOFF_MAXSHIFT	5
+// Failures in a row after which a device is taken for unplugged
+#define I2C_ABSENT_AFTER		8
+// How often I2CReprobe looks for a device which is not there
+#define I2C_REPROBE_MS			2000
+
+// TWI pins, driven by hand to clear a stuck bus
+#define I2C_PORT		PORTD
+#define I2C_DDR			DDRD
+#define I2C_PIN			PIND
+#define I2C_SCL			PD0
+#define I2C_SDA			PD1
+
+typedef enum {
+	BUS_IDLE,		// No START issued by us
+	BUS_ACTIVE,		// Transaction in progress
+	BUS_HELD		// Last transaction ended with NOSTOP, SCL is kept low
+} BusState;
+
+// Queue of pending transactions sorted by priority, the head one is on the bus
+static struct I2CXfer *volatile _head;
+static volatile uint8_t _depth;
+static volatile uint8_t _active;
+static volatile BusState _bus;
+// Position inside the head transaction
+static uint8_t _idx;
+static uint8_t _reading;
+// When the head transaction went on the bus and how long it may take
+static volatile unsigned long _startUs;
+static volatile uint16_t _limitUs;
+static unsigned long _worstWaitUs;
+
+#ifdef I2C_STATS
+static struct I2CStats _stats[I2C_STATS_SLOTS];
+static struct I2CQueueStats _qstats[I2C_PRIO_COUNT];
+// Address of the last START, continuations (NOSTART) are accounted to it
+static uint8_t _chainAddr;
+#endif
+
+/*
+ * Bus parameters and health of the known devices. A device which
+ * is not in the table is clocked at I2C_SPEED_STD and never backs off.
+ */
+struct I2CDevice {
+	uint8_t addr;
+	uint8_t twbr;
+	uint8_t twps;
+	uint8_t prio;			// I2C_PRIO_*
+	uint8_t fails;			// failed transactions in a row
+	unsigned long retryAt;	// millis() when back-off ends
+};
+static struct I2CDevice _devices[I2C_MAX_DEVICES];
+static uint8_t _ndevices;
+// Presence bitmap, bit N is _devices[N]
+static volatile uint8_t _present;
+static uint8_t _twbrStd;
+static uint8_t _twpsStd;
+
+/*
+ * SCL = F_CPU / (16 + 2 * TWBR * 4^TWPS), pick the smallest
+ * prescaler which keeps TWBR in range.
+ */
+static void _calcRate(uint32_t scl, uint8_t *twbr, uint8_t *twps)
+{
+	uint32_t div = F_CPU / scl;
+	uint32_t br;
+	uint8_t ps;
+
+	div = (div > 16) ? div - 16 : 0;
+	for (ps = 0; ps < 3; ps++) {
+		if (((div / 2) >> (2 * ps)) <= 0xFF)
+			break;
+	}
+	br = (div / 2) >> (2 * ps);
+	*twbr = (br > 0xFF) ? 0xFF : br;
+	*twps = ps;
+}
+
+static struct I2CDevice *_findDevice(uint8_t addr)
+{
+	addr &= ~I2C_READ;
+	for (uint8_t i = 0; i < _ndevices; i++) {
+		if (_devices[i].addr == addr)
+			return &_devices[i];
+	}
+	return NULL;
+}
+
+static void _setRate(struct I2CDevice *dev)
+{
+	TWBR = dev ? dev->twbr : _twbrStd;
+	TWSR = (TWSR & ~TWPS_MASK) | (dev ? dev->twps : _twpsStd);
+}
+
+/*
+ * Find a device or add it to the table with the default rate.
+ * A new device is taken as present until a probe says otherwise.
+ */
+static struct I2CDevice *_addDevice(uint8_t addr)
+{
+	struct I2CDevice *dev = _findDevice(addr);
+	uint8_t oldSREG = SREG;
+
+	if (dev != NULL || _ndevices == I2C_MAX_DEVICES)
+		return dev;
+
+	cli();
+	dev = &_devices[_ndevices];
+	dev->addr = addr & ~I2C_READ;
+	dev->twbr = _twbrStd;
+	dev->twps = _twpsStd;
+	dev->prio = I2C_PRIO_SENSOR;
+	_present |= _BV(_ndevices);
+	_ndevices++;
+	SREG = oldSREG;
+
+	return dev;
+}
+
+static void _setPresent(struct I2CDevice *dev, uint8_t present)
+{
+	if (present)
+		_present |= _BV(dev - _devices);
+	else
+		_present &= ~_BV(dev - _devices);
+}
+
+static uint8_t _isPresent(struct I2CDevice *dev)
+{
+	return dev == NULL || (_present & _BV(dev - _devices));
+}
+
+static uint8_t _backingOff(struct I2CDevice *dev)
+{
+	return dev && dev->fails >= I2C_BACKOFF_AFTER &&
+		   (long)(millis() - dev->retryAt) < 0;
+}
+
+static void _account(struct I2CDevice *dev, uint8_t status)
+{
+	uint8_t shift;
+
+	if (dev == NULL || status == EI2CBACKOFF || status == EI2CNODEV)
+		return;
+
+	if (status == ESUCCESS) {
+		dev->fails = 0;
+		_setPresent(dev, 1);
+		return;
+	}
+	if (dev->fails < 0xFF)
+		dev->fails++;
+	if (dev->fails >= I2C_ABSENT_AFTER)
+		_setPresent(dev, 0);
+	if (dev->fails >= I2C_BACKOFF_AFTER) {
+		shift = dev->fails - I2C_BACKOFF_AFTER;
+		if (shift > I2C_BACKOFF_MAXSHIFT)
+			shift = I2C_BACKOFF_MAXSHIFT;
+		dev->retryAt = millis() + ((unsigned long)I2C_BACKOFF_MS << shift);
+	}
+}
+
+/*
+ * Release a bus a slave keeps SDA low on (e.g. we were reset in the
+ * middle of its read): clock SCL until it lets SDA go, then send STOP.
+ * TWI must be disabled, the lines are driven open-drain via DDR.
+ */
+static void _busClear(void)
+{
+	I2C_PORT &= ~(_BV(I2C_SCL) | _BV(I2C_SDA));
+	I2C_DDR &= ~(_BV(I2C_SCL) | _BV(I2C_SDA));
+	_delay_us(5);
+
+	for (uint8_t i = 0; i < 9 && !(I2C_PIN & _BV(I2C_SDA)); i++) {
+		I2C_DDR |= _BV(I2C_SCL);	// SCL low
+		_delay_us(5);
+		I2C_DDR &= ~_BV(I2C_SCL);	// SCL high
+		_delay_us(5);
+	}
+
+	// STOP: SDA goes high while SCL is high
+	I2C_DDR |= _BV(I2C_SCL);
+	_delay_us(5);
+	I2C_DDR |= _BV(I2C_SDA);
+	_delay_us(5);
+	I2C_DDR &= ~_BV(I2C_SCL);
+	_delay_us(5);
+	I2C_DDR &= ~_BV(I2C_SDA);
+	_delay_us(5);
+}
+
+#ifdef I2C_STATS
+/*
+ * Account a finished transaction. Called from TWI_vect, so it only
+ * does a short table walk and a few additions.
+ */
+static void _collect(struct I2CXfer *x, uint8_t status)
+{
+	struct I2CStats *st = NULL;
+	uint8_t addr = _chainAddr >> 1;
+	uint32_t us;
+
+	if (status == EI2CBACKOFF || status == EI2CNODEV || addr == 0)
+		return;		// never went on the bus
+
+	for (uint8_t i = 0; i < I2C_STATS_SLOTS; i++) {
+		if (_stats[i].addr == addr || _stats[i].addr == 0) {
+			st = &_stats[i];
+			break;
+		}
+	}
+	if (st == NULL)
+		return;		// table is full
+
+	us = micros() - _startUs;
+	st->addr = addr;
+	st->xfers++;
+	st->wbytes += _reading ? x->wlen : _idx;
+	st->rbytes += _reading ? _idx : 0;
+	if (status == EI2CTIMEOUT)
+		st->timeouts++;
+	else if (status != ESUCCESS)
+		st->naks++;
+	st->busUs += us;
+	if (us > st->maxUs)
+		st->maxUs = us > 0xFFFF ? 0xFFFF : us;
+}
+
+/*
+ * Account the time a transaction spent in the queue,
+ * called when it goes on the bus.
+ */
+static void _queued(struct I2CXfer *x)
+{
+	struct I2CQueueStats *qs = &_qstats[x->prio];
+	uint32_t us = _startUs - x->queuedUs;
+
+	qs->xfers++;
+	qs->waitUs += us;
+	if (us > qs->maxWaitUs)
+		qs->maxWaitUs = us > 0xFFFF ? 0xFFFF : us;
+}
+#endif
+
+static void _dispatch(void);
+
+static void _finish(uint8_t status)
+{
+	struct I2CXfer *x = _head;
+
+#ifdef I2C_STATS
+	_collect(x, status);
+#endif
+
+	if (_bus != BUS_IDLE) {
+		if (status == ESUCCESS && (x->flags & I2C_XFER_NOSTOP)) {
+			/*
+			 * Leave TWINT set (writing zero to it has no effect)
+			 * and mask the interrupt, the bus stays stretched
+			 * until the next transaction continues it.
+			 */
+			TWCR = (1 << TWEN);
+			_bus = BUS_HELD;
+		} else {
+			TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);	/* Stop */
+			_bus = BUS_IDLE;
+		}
+	}
+#ifdef I2C_STATS
+	if (_bus == BUS_IDLE)
+		_chainAddr = 0;
+#endif
+
+	_head = x->next;
+	_depth--;
+	_active = 0;
+
+	if (!(x->flags & I2C_XFER_NOSTART))
+		_account(_findDevice(x->addr), status);
+
+	x->status = status;
+	if (x->done)
+		x->done(x);
+
+	_dispatch();
+}
+
+static void _readNext(struct I2CXfer *x)
+{
+	if ((_idx + 1 < x->rlen) || (x->flags & I2C_XFER_ACKLAST))
+		TWCR = TWCR_GO | (1 << TWEA);
+	else
+		TWCR = TWCR_GO;
+}
+
+static void _dispatch(void)
+{
+	struct I2CXfer *x = _head;
+	struct I2CDevice *dev;
+	unsigned long start;
+
+	if (_active || x == NULL)
+		return;
+	// A held bus belongs to its chain, everybody else waits for the STOP
+	if (_bus == BUS_HELD && x->prio != I2C_PRIO_CHAIN)
+		return;
+
+	_active = 1;
+	_idx = 0;
+	_reading = 0;
+	_startUs = micros();
+	_limitUs = I2C_TIMEOUT_US + (uint16_t)(x->wlen + x->rlen + 1) * I2C_BYTE_US;
+#ifdef I2C_STATS
+	_queued(x);
+#endif
+
+	if (x->flags & I2C_XFER_NOSTART) {
+		if (_bus != BUS_HELD) {
+			// Nothing to continue: a bare STOP is fine, data is not
+			_finish((x->wlen || x->rlen) ? EI2CWRITE : ESUCCESS);
+			return;
+		}
+		_bus = BUS_ACTIVE;
+		if (x->wlen) {
+			TWDR = x->wbuf[_idx++];
+			TWCR = TWCR_GO;
+		} else if (x->rlen) {
+			_reading = 1;
+			_readNext(x);
+		} else {
+			_finish(ESUCCESS);
+		}
+		return;
+	}
+
+#ifdef I2C_STATS
+	_chainAddr = x->addr;
+#endif
+	dev = _findDevice(x->addr);
+	if (!(x->flags & I2C_XFER_PROBE)) {
+		// Don't let a missing or dead device eat bus time, fail at once
+		if (!_isPresent(dev)) {
+			_finish(EI2CNODEV);
+			return;
+		}
+		if (_backingOff(dev)) {
+			_finish(EI2CBACKOFF);
+			return;
+		}
+	}
+
+	if (_bus == BUS_IDLE) {
+		// Let the previous STOP go out, one SCL period, a byte time at most
+		start = micros();
+		while ((TWCR & (1 << TWSTO)) && micros() - start < I2C_BYTE_US)
+			;
+	}
+	// SCL only changes between transactions
+	_setRate(dev);
+	_bus = BUS_ACTIVE;
+	TWCR = TWCR_GO | (1 << TWSTA);	/* (Repeated) start */
+}
+
+static void _service(void)
+{
+	struct I2CXfer *x = _head;
+
+	switch (TWSR_STA) {
+	case TW_START:
+	case TW_REP_START:
+		if (_reading) {
+			TWDR = x->addr | I2C_READ;
+		} else if (x->wlen) {
+			TWDR = x->addr & ~I2C_READ;
+		} else if (x->rlen) {
+			_reading = 1;
+			TWDR = x->addr | I2C_READ;
+		} else {
+			TWDR = x->addr;	/* Address only */
+		}
+		TWCR = TWCR_GO;
+		break;
+	case TW_MT_SLA_ACK:
+	case TW_MT_DATA_ACK:
+		if (_idx < x->wlen) {
+			TWDR = x->wbuf[_idx++];
+			TWCR = TWCR_GO;
+		} else if (x->rlen) {
+			_reading = 1;
+			_idx = 0;
+			TWCR = TWCR_GO | (1 << TWSTA);	/* Repeated start */
+		} else {
+			_finish(ESUCCESS);
+		}
+		break;
+	case TW_MR_SLA_ACK:
+		_idx = 0;
+		if (x->rlen)
+			_readNext(x);
+		else
+			_finish(ESUCCESS);
+		break;
+	case TW_MR_DATA_ACK:
+	case TW_MR_DATA_NACK:
+		x->rbuf[_idx++] = TWDR;
+		if (_idx < x->rlen)
+			_readNext(x);
+		else
+			_finish(ESUCCESS);
+		break;
+	case TW_MT_ARB_LOST:
+		TWCR = (1 << TWINT) | (1 << TWEN);	/* Release the bus */
+		_bus = BUS_IDLE;
+		_finish(EI2CWRITE);
+		break;
+	case TW_MR_SLA_NACK:
+		_finish(EI2CREAD);
+		break;
+	default:	/* SLA/data NACK, bus error */
+		_finish(_reading ? EI2CREAD : EI2CWRITE);
+		break;
+	}
+}
+
+ISR(TWI_vect)
+{
+	_service();
+}
+
+/*
+ * Drop the head transaction, clear the bus and restart TWI,
+ * used when the bus does not move anymore.
+ */
+static void _abort(void)
+{
+	uint8_t oldSREG = SREG;
+
+	cli();
+	if (_active) {
+		TWCR = 0;
+		_busClear();
+		TWCR = (1 << TWEN);
+		_bus = BUS_IDLE;
+		_finish(EI2CTIMEOUT);
+	}
+	SREG = oldSREG;
+}
+
+/*
+ * Fail a transaction which did not get on the bus in time. The only
+ * way to get stuck in the queue is behind a held bus whose chain does
+ * not go on, that bus is released for the rest of the queue.
+ */
+static void _stall(struct I2CXfer *xfer)
+{
+	struct I2CXfer *volatile *pos = &_head;
+	uint8_t oldSREG = SREG;
+
+	cli();
+	if (!_active && xfer->status == EI2CBUSY) {
+		while (*pos != xfer)
+			pos = &(*pos)->next;
+		*pos = xfer->next;
+		_depth--;
+		if (_bus == BUS_HELD) {
+			TWCR = 0;
+			_busClear();
+			TWCR = (1 << TWEN);
+			_bus = BUS_IDLE;
+		}
+		xfer->status = EI2CTIMEOUT;
+		if (xfer->done)
+			xfer->done(xfer);
+		_dispatch();
+	}
+	SREG = oldSREG;
+}
+
 uint8_t I2CInit(void)
 {
-	TWBR = 18; // 100 kHZ
+	// A slave may still hold SDA low if we were reset mid-transfer
+	if (!(I2C_PIN & _BV(I2C_SDA)))
+		_busClear();
+
+	_calcRate(I2C_SPEED_STD, &_twbrStd, &_twpsStd);
+	TWBR = _twbrStd;
+	TWSR = (TWSR & ~TWPS_MASK) | _twpsStd;
 	TWCR |= (1<<TWEN);	/* Enable TWI */
 	return ESUCCESS;
 }
 
-uint8_t I2CStart(uint8_t addr)
+// Set the priority class (I2C_PRIO_*) of a device
+uint8_t I2CSetPriority(uint8_t addr, uint8_t prio)
+{
+	struct I2CDevice *dev = _addDevice(addr);
+
+	if (dev == NULL)
+		return EI2CNOSLOT;
+	dev->prio = prio;
+
+	return ESUCCESS;
+}
+
+/*
+ * Register the max SCL rate (Hz) a device supports.
+ * It is applied on every START addressed to that device.
+ */
+uint8_t I2CSetSpeed(uint8_t addr, uint32_t scl)
+{
+	struct I2CDevice *dev = _addDevice(addr);
+	uint8_t twbr, twps;
+	uint8_t oldSREG = SREG;
+
+	if (dev == NULL)
+		return EI2CNOSLOT;
+
+	_calcRate(scl, &twbr, &twps);
+	cli();
+	dev->twbr = twbr;
+	dev->twps = twps;
+	SREG = oldSREG;
+
+	return ESUCCESS;
+}
+
+/*
+ * Check whether a device answers its address and remember the result.
+ * Transactions to a device marked absent fail at once with EI2CNODEV.
+ */
+uint8_t I2CProbe(uint8_t addr)
 {
-	uint8_t i = 0;
-	TWCR = (1 << TWINT) | (1 << TWEN) |
-		   (1 << TWSTA) | (0 << TWSTO);	/* Start */
-	while (!(TWCR & (1<<TWINT))) {				/* Wait for TWINT */
-		if (i++ > 250)	/* Avoid endless loop */
-			return EI2CSTARTLOOP;
+	struct I2CDevice *dev = _addDevice(addr);
+	uint8_t status;
+
+	status = I2CScanBus(addr & ~I2C_READ);
+	if (dev != NULL) {
+		dev->fails = 0;
+		_setPresent(dev, status == ESUCCESS);
 	}
 
-	return I2CWriteByte(addr);
+	return status;
 }
 
-uint8_t I2CStop(void)
+/*
+ * Probe one absent device every I2C_REPROBE_MS, round robin.
+ * Returns the address of a device which came back, 0 otherwise.
+ * The caller is expected to re-initialize that device.
+ */
+uint8_t I2CReprobe(void)
 {
-	uint8_t i = 0;
-	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);	/* Stop */
-	while (TWCR & (1<<TWSTO)) {					/* Wait for TWSTO */
-		if (i++ > 250)	/* Avoid endless loop */
-			return EI2CSTOPLOOP;
+	static unsigned long next;
+	static uint8_t slot;
+
+	if ((long)(millis() - next) < 0)
+		return 0;
+	next = millis() + I2C_REPROBE_MS;
+
+	for (uint8_t i = 0; i < _ndevices; i++) {
+		if (++slot >= _ndevices)
+			slot = 0;
+		if (!(_present & _BV(slot))) {
+			if (I2CProbe(_devices[slot].addr) == ESUCCESS)
+				return _devices[slot].addr;
+			break;
+		}
 	}
-	return ESUCCESS;
+
+	return 0;
 }
 
-uint8_t I2CWriteByte(uint8_t data)
+// Unknown devices are taken as present
+uint8_t I2CPresent(uint8_t addr)
+{
+	return _isPresent(_findDevice(addr));
+}
+
+// Bit N is set if the Nth registered device is present
+uint8_t I2CPresenceMap(void)
+{
+	return _present;
+}
+
+/*
+ * Queue a transaction, it will be run from TWI_vect.
+ * Completion is reported via xfer->status and xfer->done.
+ * The queue is kept sorted by priority, so a long display
+ * stream split into several transactions lets a clock or
+ * sensor read in between.
+ */
+uint8_t I2CSubmit(struct I2CXfer *xfer)
 {
-	uint8_t i = 0;
-	TWDR = data;
-	TWCR |= (1<<TWEA);
-	TWCR = (1<<TWEN) | (1<<TWINT);	/* Start data transfer */
+	struct I2CXfer *volatile *pos = &_head;
+	struct I2CDevice *dev;
+	uint8_t oldSREG = SREG;
 
-	while (!(TWCR & (1<<TWINT))) {	/* Wait for finish */
-		if (i++ > 250)	/* Avoid endless loop */
-			return EI2CWRITELOOP;
+	xfer->status = EI2CBUSY;
+	if (xfer->flags & (I2C_XFER_NOSTART | I2C_XFER_NOSTOP)) {
+		xfer->prio = I2C_PRIO_CHAIN;
+	} else {
+		dev = _findDevice(xfer->addr);
+		xfer->prio = dev ? dev->prio : I2C_PRIO_SENSOR;
 	}
 
-	if (TWSR_STA != 0x18 && TWSR_STA != 0x28 && TWSR_STA != 0x40)
-		return EI2CWRITE;
+	cli();
+#ifdef I2C_STATS
+	xfer->queuedUs = micros();
+	if (_depth + 1 > _qstats[xfer->prio].maxDepth)
+		_qstats[xfer->prio].maxDepth = _depth + 1;
+#endif
+	// The transaction on the bus stays first
+	if (_active)
+		pos = &_head->next;
+	while (*pos && (*pos)->prio <= xfer->prio)
+		pos = &(*pos)->next;
+	xfer->next = *pos;
+	*pos = xfer;
+	_depth++;
+	_dispatch();
+	SREG = oldSREG;
+
 	return ESUCCESS;
 }
 
-uint8_t I2CReadByte(uint8_t *data, uint8_t ack)
+/*
+ * Abort the transaction on the bus if it ran out of time. Must be
+ * called periodically by users of I2CSubmit which don't I2CWait.
+ */
+void I2CPoll(void)
 {
-	uint8_t i = 0;
-	if (ack)
-		TWCR |= (1<<TWEA);
-	else
-		TWCR &= ~(1<<TWEA);
-	TWCR |= (1 << TWINT) | (1 << TWEN);
+	uint8_t oldSREG = SREG;
+
+	// TWI_vect moves on to the next transaction and restamps _startUs
+	cli();
+	if (_active && micros() - _startUs > _limitUs)
+		_abort();
+	SREG = oldSREG;
+}
+
+/*
+ * Wait for a queued transaction. A transaction on the bus is aborted
+ * after _limitUs, one waiting without anything on the bus (behind a
+ * held bus) fails after its own time limit. A new head of the queue
+ * is progress and restarts the count.
+ */
+uint8_t I2CWait(struct I2CXfer *xfer)
+{
+	struct I2CXfer *head = _head;
+	unsigned long start = micros();
+	unsigned long since = start;
+	unsigned long wait;
+	uint16_t limit = I2C_TIMEOUT_US + (uint16_t)(xfer->wlen + xfer->rlen + 1) * I2C_BYTE_US;
+	uint16_t spin = 0;
 
-	while (!(TWCR & (1<<TWINT))) {	/* Wait for finish */
-		if (i++ > 250)	/* Avoid endless loop */
-			return TWSR;
+	while (xfer->status == EI2CBUSY) {
+		if (SREG & _BV(SREG_I)) {
+			I2CPoll();
+			if (head != _head) {
+				head = _head;
+				since = micros();
+			} else if (!_active && micros() - since > limit) {
+				_stall(xfer);
+			}
+			continue;
+		}
+		/*
+		 * Interrupts are off, so neither TWI_vect nor the timer tick
+		 * run: service TWI by polling and count time in 1 us steps.
+		 */
+		if ((TWCR & ((1 << TWINT) | (1 << TWIE))) == ((1 << TWINT) | (1 << TWIE)))
+			_service();
+		if (head != _head) {
+			head = _head;
+			spin = 0;
+		}
+		_delay_us(1);
+		if (++spin > (_active ? _limitUs : limit)) {
+			if (_active)
+				_abort();
+			else
+				_stall(xfer);
+			spin = 0;
+		}
 	}
 
-	if (TWSR_STA != 0x58 && TWSR_STA != 0x50)
-		return EI2CREAD;
+	if (SREG & _BV(SREG_I)) {
+		wait = micros() - start;
+		if (wait > _worstWaitUs)
+			_worstWaitUs = wait;
+	}
+
+	return xfer->status;
+}
+
+// Longest I2CWait seen so far, us
+unsigned long I2CWorstWait(void)
+{
+	return _worstWaitUs;
+}
+
+#ifdef I2C_STATS
+uint8_t I2CStatsGet(uint8_t slot, struct I2CStats *stats)
+{
+	uint8_t oldSREG = SREG;
+
+	if (slot >= I2C_STATS_SLOTS || _stats[slot].addr == 0)
+		return ENULLPOINTER;
+
+	cli();
+	*stats = _stats[slot];
+	SREG = oldSREG;
 
-	*data = TWDR;
 	return ESUCCESS;
 }
 
-uint8_t I2CScanBus(uint8_t addr)
+uint8_t I2CQueueStatsGet(uint8_t prio, struct I2CQueueStats *stats)
 {
-	uint8_t status;
+	uint8_t oldSREG = SREG;
 
-	status = I2CStart(addr);
+	if (prio >= I2C_PRIO_COUNT)
+		return ENULLPOINTER;
 
-	I2CStop();
+	cli();
+	*stats = _qstats[prio];
+	SREG = oldSREG;
 
-	return status;
+	return ESUCCESS;
+}
+
+void I2CStatsReset(void)
+{
+	uint8_t oldSREG = SREG;
+
+	cli();
+	for (uint8_t i = 0; i < I2C_STATS_SLOTS; i++)
+		_stats[i] = (struct I2CStats){ 0 };
+	for (uint8_t i = 0; i < I2C_PRIO_COUNT; i++)
+		_qstats[i] = (struct I2CQueueStats){ 0 };
+	_worstWaitUs = 0;
+	SREG = oldSREG;
+}
+#endif
+
+uint8_t I2CTransfer(struct I2CXfer *xfer)
+{
+	I2CSubmit(xfer);
+	return I2CWait(xfer);
+}
+
+static uint8_t _blocking(uint8_t addr, uint8_t flags,
+						 const uint8_t *wbuf, uint8_t wlen,
+						 uint8_t *rbuf, uint8_t rlen)
+{
+	struct I2CXfer xfer = {
+		.addr = addr,
+		.flags = flags,
+		.wbuf = wbuf,
+		.wlen = wlen,
+		.rbuf = rbuf,
+		.rlen = rlen,
+	};
+
+	return I2CTransfer(&xfer);
+}
+
+/*
+ * Burst transfers. Each one is a single transaction: START, the whole
+ * buffer and STOP. I2CWriteThenRead switches to reading with a repeated
+ * START, which is what register-oriented devices expect.
+ */
+uint8_t I2CWriteBuf(uint8_t addr, const uint8_t *buf, uint8_t len)
+{
+	return _blocking(addr, 0, buf, len, NULL, 0);
+}
+
+uint8_t I2CReadBuf(uint8_t addr, uint8_t *buf, uint8_t len)
+{
+	return _blocking(addr, 0, NULL, 0, buf, len);
+}
+
+uint8_t I2CWriteThenRead(uint8_t addr, const uint8_t *wbuf, uint8_t wlen,
+						 uint8_t *rbuf, uint8_t rlen)
+{
+	return _blocking(addr, 0, wbuf, wlen, rbuf, rlen);
+}
+
+uint8_t I2CStart(uint8_t addr)
+{
+	return _blocking(addr, I2C_XFER_NOSTOP, NULL, 0, NULL, 0);
+}
+
+uint8_t I2CStop(void)
+{
+	return _blocking(0, I2C_XFER_NOSTART, NULL, 0, NULL, 0);
+}
+
+uint8_t I2CWriteByte(uint8_t data)
+{
+	return _blocking(0, I2C_XFER_NOSTART | I2C_XFER_NOSTOP, &data, 1, NULL, 0);
+}
+
+uint8_t I2CReadByte(uint8_t *data, uint8_t ack)
+{
+	return _blocking(0, I2C_XFER_NOSTART | I2C_XFER_NOSTOP |
+					 (ack ? I2C_XFER_ACKLAST : 0), NULL, 0, data, 1);
+}
+
+uint8_t I2CScanBus(uint8_t addr)
+{
+	return _blocking(addr, I2C_XFER_PROBE, NULL, 0, NULL, 0);
 }
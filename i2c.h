@@ -10,8 +10,118 @@
 #define I2C_ACK		1
 #define I2C_READ	1
 
+// SCL rates, in Hz
+#define I2C_SPEED_STD		100000UL
+#define I2C_SPEED_FAST		400000UL
+// Max number of devices with their own bus parameters
+#define I2C_MAX_DEVICES		6
+
+/*
+ * Priority classes, the queue is served in this order and FIFO
+ * within a class. Transactions holding or continuing a held bus
+ * (byte-level API) are I2C_PRIO_CHAIN, the rest take the class
+ * of their device, I2C_PRIO_SENSOR by default.
+ */
+#define I2C_PRIO_CHAIN		0
+#define I2C_PRIO_TIME		1
+#define I2C_PRIO_SENSOR		2
+#define I2C_PRIO_DISPLAY	3
+#define I2C_PRIO_COUNT		4
+
+/*
+ * Transaction flags:
+ *	- I2C_XFER_NOSTART - continue on the bus held by the previous
+ *	  transaction instead of generating a (repeated) START
+ *	- I2C_XFER_NOSTOP - keep the bus (SCL low) after the last byte,
+ *	  so the next transaction can continue it
+ *	- I2C_XFER_ACKLAST - ACK the last received byte, more reads follow
+ */
+#define I2C_XFER_NOSTART	0x01
+#define I2C_XFER_NOSTOP		0x02
+#define I2C_XFER_ACKLAST	0x04
+// Go on the bus even if the device is marked absent or backing off
+#define I2C_XFER_PROBE		0x08
+
+struct I2CXfer;
+typedef void (*I2CCallback)(struct I2CXfer *xfer);
+
+/*
+ * Transaction descriptor. It is owned by the caller and must stay
+ * valid until status leaves EI2CBUSY. The engine writes wbuf first,
+ * then reads rbuf after a repeated START. A descriptor without data
+ * sends the address byte as given (R/W bit included) and nothing else.
+ */
+struct I2CXfer {
+	uint8_t addr;				// 8-bit slave address
+	uint8_t flags;				// I2C_XFER_*
+	const uint8_t *wbuf;		// data to write
+	uint8_t wlen;
+	uint8_t *rbuf;				// data to read
+	uint8_t rlen;
+	volatile uint8_t status;	// EI2CBUSY until completed
+	I2CCallback done;			// called from TWI_vect on completion, may be NULL
+	// Used by the engine
+	struct I2CXfer *next;		// queue link
+	uint8_t prio;				// I2C_PRIO_*
+#ifdef I2C_STATS
+	unsigned long queuedUs;		// micros() when submitted
+#endif
+};
+
+#ifdef I2C_STATS
+// Number of addresses tracked by the bus statistics
+#define I2C_STATS_SLOTS		8
+
+// Bus statistics of one slave, addr == 0 marks an unused slot
+struct I2CStats {
+	uint8_t addr;			// 7-bit address
+	uint16_t xfers;			// transactions
+	uint32_t wbytes;		// bytes written, address bytes excluded
+	uint32_t rbytes;		// bytes read
+	uint16_t naks;			// NAKs, arbitration and bus errors
+	uint16_t timeouts;
+	uint32_t busUs;			// cumulative time on the bus, us
+	uint16_t maxUs;			// longest transaction, us, stops at 0xFFFF
+};
+
+// Queue statistics of one priority class
+struct I2CQueueStats {
+	uint16_t xfers;			// transactions which went through the queue
+	uint32_t waitUs;		// cumulative time in the queue, us
+	uint16_t maxWaitUs;		// longest time in the queue, us, stops at 0xFFFF
+	uint8_t maxDepth;		// deepest queue found on submit
+};
+#endif
+
 uint8_t I2CInit(void);
+uint8_t I2CSetSpeed(uint8_t addr, uint32_t scl);
+uint8_t I2CSetPriority(uint8_t addr, uint8_t prio);
+
+// Device presence
+uint8_t I2CProbe(uint8_t addr);
+uint8_t I2CReprobe(void);
+uint8_t I2CPresent(uint8_t addr);
+uint8_t I2CPresenceMap(void);
+
+// Transaction engine
+uint8_t I2CSubmit(struct I2CXfer *xfer);
+uint8_t I2CWait(struct I2CXfer *xfer);
+uint8_t I2CTransfer(struct I2CXfer *xfer);
+void I2CPoll(void);
+unsigned long I2CWorstWait(void);
+#ifdef I2C_STATS
+uint8_t I2CStatsGet(uint8_t slot, struct I2CStats *stats);
+uint8_t I2CQueueStatsGet(uint8_t prio, struct I2CQueueStats *stats);
+void I2CStatsReset(void);
+#endif
+
+// Blocking burst API, one transaction per call
+uint8_t I2CWriteBuf(uint8_t addr, const uint8_t *buf, uint8_t len);
+uint8_t I2CReadBuf(uint8_t addr, uint8_t *buf, uint8_t len);
+uint8_t I2CWriteThenRead(uint8_t addr, const uint8_t *wbuf, uint8_t wlen,
+						 uint8_t *rbuf, uint8_t rlen);
 
+// Blocking byte-level API, wrappers over the engine
 uint8_t I2CStart(uint8_t addr);
 uint8_t I2CStop(void);
 
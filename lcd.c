@@ -1,13 +1,23 @@
 #include <util/delay.h>
+#include <string.h>
 #include <compat/twi.h>
 #include <util/twi.h>
+#include <avr/io.h>
 #include <avr/pgmspace.h>
+#include <avr/interrupt.h>
 #include "lcd.h"
 #include "i2c.h"
+#include "errorno.h"
+#include "timer.h"
 
 #define PCF8574T_ID			0x40
 #define PCF8574T_ADR		0x00
 
+// Busy flag in the status read
+#define LCD_BUSY			0x80
+// Worst case execution time of Clear display, us
+#define LCD_CLEAR_US		1520
+
 /*
  * MSB = data
  * LSB:
@@ -52,34 +62,210 @@ static const uint8_t cgram_char[8] PROGMEM = {
 	0x40, 0x48, 0x50, 0x58, 0x60, 0x68, 0x70, 0x78
 };
 
-static void _strobe(void)
+/*
+ * Bytes for the PCF8574 are collected here and sent as one
+ * I2C write by _flush(). Every nibble is an E-high/E-low byte
+ * pair: one byte on the bus is longer than the HD44780 enable
+ * pulse, and a pair is longer than the 37 us command time,
+ * so no delays are needed between them. The buffer holds a
+ * whole line, with the two address commands and RS switches
+ * a single-line display needs for it; _put() drops anything
+ * past that.
+ */
+#define LCD_TX_SIZE			(2 * (2 + 4) + LCD_COLS * 4)
+static uint8_t _tx[LCD_TX_SIZE];
+static uint8_t _txlen;
+
+/*
+ * Frame buffer written by the application, pushed to the LCD one
+ * run of changed chars at a time: lcdRefresh() in the loop finds
+ * the run and queues it in _tx, the timer tick only submits it.
+ * A run of LCD_SLICE_CHARS is 38 bytes, under 1 ms at 400 kHz.
+ */
+#define LCD_SLICE_CHARS		8
+static char _frame[NUM_LINES][LCD_COLS];
+static volatile uint8_t _dirty;
+// A blocking call owns the LCD, the tick keeps off
+static volatile uint8_t _locked;
+// _tx holds a slice for the tick to submit
+static volatile uint8_t _ready;
+static volatile uint8_t _inFlight;
+static struct I2CXfer _slice;
+static unsigned long _sliceStart;
+static uint16_t _maxSliceUs;
+// Bytes sent for the frame in progress and the last complete one
+static uint16_t _frameBytes;
+static uint16_t _lastFrameBytes;
+
+/*
+ * Glyph cache. The glyph of every CGRAM slot is tracked, a slot
+ * shows in DDRAM as LCD_SLOT_CHAR(slot) (0x08-0x0F, as 0x00 is a
+ * NUL in the frame). A missing glyph takes the least recently used
+ * slot the frame doesn't need, one not on the screen if possible.
+ */
+#define LCD_SLOTS			8
+#define LCD_SLOT_CHAR(s)	(0x08 | (s))
+#define LCD_NO_GLYPH		0xFF
+// Shown for a glyph which gets no slot, more than 8 on the screen
+#define LCD_GLYPH_MISSING	'?'
+static const char (*_glyphs)[8];
+static uint8_t _nglyphs;
+static uint8_t _slotGlyph[LCD_SLOTS];
+static uint16_t _slotUsed[LCD_SLOTS];
+static uint16_t _lruClock;
+static uint16_t _cgramWrites;
+
+/*
+ * Copy of the DDRAM contents, so update() sends the chars
+ * which differ from it only. '\0' never comes from a frame,
+ * it marks a cell in unknown state.
+ */
+static char _shadow[NUM_LINES][LCD_COLS];
+
+/*
+ * The busy flag can not be read, RW is not wired on some backpacks.
+ * Set until lcdInit() has seen it work.
+ */
+static uint8_t _noBusyFlag = 1;
+
+static void _flush(void)
+{
+	if (_txlen) {
+		// Whatever we have written might be lost, redraw everything
+		if (I2CWriteBuf(LCD_I2C_ADDR, _tx, _txlen) != ESUCCESS)
+			memset(_shadow, 0, sizeof(_shadow));
+		_txlen = 0;
+	}
+}
+
+// Never flushes by itself: that would block in the middle of a slice
+static void _put(uint8_t value)
+{
+	if (_txlen < LCD_TX_SIZE)
+		_tx[_txlen++] = value;
+}
+
+/*
+ * Switch between commands and data. RS has to settle before
+ * E goes high, so it gets a byte of its own when it changes.
+ */
+static void _mode(uint8_t rs)
 {
+	if (lcd.rs != rs) {
+		lcd.rs = rs;
+		_put(lcd.value);
+	}
+}
+
+// Clock one nibble in, data is latched on the E falling edge
+static void _nibble(uint8_t data)
+{
+	lcd.data = data;
 	lcd.en = enable;
-	I2CWriteByte(lcd.value);
-	_delay_us(10);
+	_put(lcd.value);
 	lcd.en = disable;
-	I2CWriteByte(lcd.value);
-	_delay_us(10);
+	_put(lcd.value);
+}
+
+static void _command(uint8_t cmd)
+{
+	_mode(disable);
+	_nibble(cmd >> 4);
+	_nibble(cmd & 0x0F);
 }
 
 static void _putchar(char data)
 {
-	uint8_t ret = 0x00;
+	_mode(enable);
+	_nibble((uint8_t)data >> 4);
+	_nibble(data & 0x0F);
+}
+
+/*
+ * Read the busy flag and address counter. The data pins are
+ * released (written high) with RW set and each nibble is read
+ * while E is high; the low one has to be clocked out as well.
+ * With RW tied low these strobes write the released pins to the
+ * LCD instead, so this is only called once _probeBusyFlag() has
+ * found the read to work.
+ */
+static uint8_t _readStatus(uint8_t *status)
+{
+	uint8_t w[2], hi, lo;
+	uint8_t ret;
 
-	lcd.rs = enable;
+	lcd.rs = disable;
+	lcd.rw = enable;
+	lcd.data = 0x0F;
+	w[0] = lcd.value;
+	lcd.en = enable;
+	w[1] = lcd.value;
+	lcd.en = disable;
+
+	ret = I2CWriteThenRead(LCD_I2C_ADDR, w, 2, &hi, 1);
+	if (ret == ESUCCESS)
+		ret = I2CWriteThenRead(LCD_I2C_ADDR, w, 2, &lo, 1);
+
+	// Drop E first, RW has to stay set a while after it (tAH)
 	lcd.rw = disable;
+	w[1] = lcd.value;
+	if (ret == ESUCCESS)
+		ret = I2CWriteBuf(LCD_I2C_ADDR, w, 2);
 
-	ret = (data & 0xf0) >> 4;
-	lcd.data = ret;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_us(1);
+	*status = (hi & 0xF0) | (lo >> 4);
 
-	ret = ((data << 4) & 0xf0) >> 4;
-	lcd.data = ret;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_us(1);
+	return ret;
+}
+
+/*
+ * Wait until the LCD is done with the last command, at most us.
+ * The busy flag is polled, so we go on as soon as it is ready.
+ * When it can't be read the fixed delay is used instead.
+ */
+static void _wait(uint16_t us)
+{
+	unsigned long start;
+	uint8_t status;
+
+	_flush();
+
+	if (!_noBusyFlag) {
+		start = micros();
+		while (_readStatus(&status) == ESUCCESS) {
+			if (!(status & LCD_BUSY))
+				return;
+			// Stuck busy, don't trust the flag anymore
+			if (micros() - start >= us) {
+				_noBusyFlag = 1;
+				return;
+			}
+		}
+	}
+
+	for (; us >= 10; us -= 10)
+		_delay_us(10);
+}
+
+/*
+ * Find out whether the busy flag can be read, once, at a point
+ * the LCD is known to be idle with the address counter at 0:
+ * the status then has to read 0x00. With RW tied low the PCF8574
+ * reads back its own released pins, 0xFF, and the two strobes
+ * have clocked 0xFF in as a command, Set DDRAM address 0x7F.
+ * Return home undoes that.
+ */
+static void _probeBusyFlag(void)
+{
+	uint8_t status;
+
+	_noBusyFlag = 1;
+	if (_readStatus(&status) == ESUCCESS && status == 0x00) {
+		_noBusyFlag = 0;
+		return;
+	}
+
+	_command(0x02);
+	_wait(LCD_CLEAR_US);
 }
 
 #ifdef TWO_LINE_LCD
@@ -88,27 +274,107 @@ static void setPosition(uint8_t line, uint8_t index)
 static void setPosition(uint8_t index)
 #endif
 {
-	lcd.rs = disable;
-	lcd.rw = disable;
-
 	// Select DDRAM address
 #ifdef TWO_LINE_LCD
-	lcd.data = ((pgm_read_byte(&pos[line][index])) >> 4);
+	_command(pgm_read_byte(&pos[line][index]));
 #else
-	lcd.data = ((pgm_read_byte(&pos[index])) >> 4);
+	_command(pgm_read_byte(&pos[index]));
 #endif
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_us(1);
+}
 
+/*
+ * Queue size chars for the given position and keep the shadow in sync.
+ * The address is set once, entry mode (0x06) moves the cursor right
+ * after every char.
+ */
+static void _writeRun(const char *data, uint8_t line,
+					  uint8_t start, uint8_t size)
+{
+	for (uint8_t i = start; i < (start + size); i++) {
 #ifdef TWO_LINE_LCD
-	lcd.data = ((pgm_read_byte(&pos[line][index])) & 0x0F);
+		if (i == start)
+			setPosition(line, i);
 #else
-	lcd.data = ((pgm_read_byte(&pos[index])) & 0x0F);
+		// The halves of a single-line display are not contiguous in DDRAM
+		if (i == start || i == 8)
+			setPosition(i);
 #endif
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_us(1);
+		_shadow[line][i] = *data;
+		_putchar(*data++);
+	}
+}
+
+/*
+ * Keep the background refresh away from _tx and the LCD
+ * while a blocking call is talking to it. A slice the tick
+ * has not taken yet is sent here, _shadow already has it.
+ */
+static void _lock(void)
+{
+	_locked = 1;
+	if (_inFlight)
+		I2CWait(&_slice);
+	_ready = 0;
+	_flush();
+}
+
+static void _unlock(void)
+{
+	_locked = 0;
+}
+
+// Cache slot holding a glyph, LCD_NO_GLYPH if it is not loaded
+static uint8_t _findSlot(uint8_t glyph)
+{
+	for (uint8_t s = 0; s < LCD_SLOTS; s++) {
+		if (_slotGlyph[s] == glyph)
+			return s;
+	}
+
+	return LCD_NO_GLYPH;
+}
+
+// The char a frame char is written to DDRAM as
+static char _render(char c)
+{
+	uint8_t glyph = (uint8_t)c - LCD_GLYPH_BASE;
+	uint8_t s;
+
+	if (glyph >= LCD_GLYPH_MAX)
+		return c;
+
+	s = _findSlot(glyph);
+	if (s == LCD_NO_GLYPH)
+		return LCD_GLYPH_MISSING;
+	_slotUsed[s] = ++_lruClock;
+
+	return LCD_SLOT_CHAR(s);
+}
+
+/*
+ * Write chars through the frame, so the refresh keeps them, and
+ * to the LCD right away. A line ending before start is padded.
+ */
+static void _print(const char *data, uint8_t line,
+				   uint8_t start, uint8_t size)
+{
+	char run[LCD_COLS];
+	uint8_t len;
+
+	_lock();
+	len = strnlen(_frame[line], LCD_COLS);
+	for (; len < start; len++)
+		_frame[line][len] = ' ';
+	memcpy(&_frame[line][start], data, size);
+
+	for (uint8_t i = 0; i < size; i++)
+		run[i] = _render(data[i]);
+	_writeRun(run, line, start, size);
+	// A glyph not loaded yet shows once the refresh gets to it
+	_dirty = 1;
+
+	_flush();
+	_unlock();
 }
 
 #ifdef TWO_LINE_LCD
@@ -117,19 +383,18 @@ static uint8_t lcdPrintChar(char data, uint8_t line, uint8_t start)
 static uint8_t lcdPrintChar(char data, uint8_t start)
 #endif
 {
-	if (start > 15)
+	if (start >= LCD_COLS)
+		return -1;
+	if (!I2CPresent(LCD_I2C_ADDR))
 		return -1;
-
-	I2CStart(LCD_I2C_ADDR);
 
 #ifdef TWO_LINE_LCD
-	setPosition(line, start);
+	if (line >= NUM_LINES)
+		return -1;
+	_print(&data, line, start, 1);
 #else
-	setPosition(start);
+	_print(&data, 0, start, 1);
 #endif
-	_putchar(data);
-
-	I2CStop();
 
 	return 0;
 }
@@ -143,55 +408,238 @@ static uint8_t lcdPrintString(char *data, uint8_t start, uint8_t size)
 {
 	uint8_t ret = 0;
 
-	if ((start + size) > 16)
+	if ((start + size) > LCD_COLS)
+		return -1;
+	if (!I2CPresent(LCD_I2C_ADDR))
 		return -1;
 
-	I2CStart(LCD_I2C_ADDR);
-
-	for (uint8_t i = start; i < (start + size); i++) {
 #ifdef TWO_LINE_LCD
-		setPosition(line, i);
+	if (line >= NUM_LINES)
+		return -1;
+	_print(data, line, start, size);
 #else
-		setPosition(i);
+	_print(data, 0, start, size);
 #endif
-		_putchar(*data++);
+
+	return ret;
+}
+
+// Pick a slot for a new glyph, keeping the ones in need
+static uint8_t _victim(uint8_t need)
+{
+	uint8_t visible = 0, best = LCD_NO_GLYPH;
+	uint8_t c;
+
+	for (uint8_t l = 0; l < NUM_LINES; l++) {
+		for (uint8_t i = 0; i < LCD_COLS; i++) {
+			c = _shadow[l][i];
+			if (c >= LCD_SLOT_CHAR(0) && c <= LCD_SLOT_CHAR(LCD_SLOTS - 1))
+				visible |= _BV(c & 0x07);
+		}
 	}
 
-	I2CStop();
+	for (uint8_t s = 0; s < LCD_SLOTS; s++) {
+		if (need & _BV(s))
+			continue;
+		if (_slotGlyph[s] == LCD_NO_GLYPH)
+			return s;
+		if (best == LCD_NO_GLYPH) {
+			best = s;
+			continue;
+		}
+		// Prefer slots off the screen, then the least recently used
+		if ((visible & _BV(best)) && !(visible & _BV(s)))
+			best = s;
+		else if ((visible & _BV(best)) == (visible & _BV(s)) &&
+				 (uint16_t)(_lruClock - _slotUsed[s]) >
+				 (uint16_t)(_lruClock - _slotUsed[best]))
+			best = s;
+	}
 
-	return ret;
+	return best;
 }
 
-static void lcdBacklight(uint8_t sw)
+/*
+ * Queue the CGRAM write of the first glyph the frame needs
+ * and the cache lacks. Returns 0 when there is none.
+ */
+static uint8_t _nextGlyph(void)
 {
-	I2CStart(LCD_I2C_ADDR);
+	uint8_t need = 0, missing = LCD_NO_GLYPH;
+	uint8_t glyph, s, len;
+
+	for (uint8_t l = 0; l < NUM_LINES; l++) {
+		len = strnlen(_frame[l], LCD_COLS);
+		for (uint8_t i = 0; i < len; i++) {
+			glyph = (uint8_t)_frame[l][i] - LCD_GLYPH_BASE;
+			if (glyph >= _nglyphs)
+				continue;
+			s = _findSlot(glyph);
+			if (s != LCD_NO_GLYPH)
+				need |= _BV(s);
+			else if (missing == LCD_NO_GLYPH)
+				missing = glyph;
+		}
+	}
+	if (missing == LCD_NO_GLYPH)
+		return 0;
+
+	s = _victim(need);
+	if (s == LCD_NO_GLYPH)
+		return 0;
+
+	/*
+	 * Cells showing the old glyph change along, they differ
+	 * from the frame and are rewritten by the next runs.
+	 */
+	_slotGlyph[s] = missing;
+	_slotUsed[s] = ++_lruClock;
+	_command(pgm_read_byte(&cgram_char[s]));
+	for (uint8_t k = 0; k < 8; k++)
+		_putchar(pgm_read_byte(&_glyphs[missing][k]));
+	_cgramWrites++;
+
+	return 1;
+}
 
-	lcd.rs = disable;
-	lcd.rw = disable;
-	lcd.backlight = sw;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_us(1);
+/*
+ * Find the next run of changed chars, at most LCD_SLICE_CHARS,
+ * and queue it in _tx. Returns 0 when the screen is up to date.
+ */
+static uint8_t _nextRun(void)
+{
+	char run[LCD_SLICE_CHARS];
+	uint8_t i, len, n;
+
+	for (uint8_t l = 0; l < NUM_LINES; l++) {
+		len = strnlen(_frame[l], LCD_COLS);
+		for (i = 0; i < LCD_COLS; i++) {
+			for (n = 0; n < LCD_SLICE_CHARS && (i + n) < LCD_COLS; n++) {
+				run[n] = (i + n) < len ? _render(_frame[l][i + n]) : ' ';
+				if (run[n] == _shadow[l][i + n])
+					break;
+			}
+			if (n) {
+				_writeRun(run, l, i, n);
+				return 1;
+			}
+		}
+	}
 
-	I2CStop();
+	return 0;
 }
 
-static void lcdClear(void)
+static void _sliceDone(struct I2CXfer *xfer)
 {
-	I2CStart(LCD_I2C_ADDR);
+	uint16_t us = micros() - _sliceStart;
+
+	if (us > _maxSliceUs)
+		_maxSliceUs = us;
+	// Whatever we have written might be lost, redraw everything
+	if (xfer->status != ESUCCESS) {
+		memset(_shadow, 0, sizeof(_shadow));
+		_dirty = 1;
+	}
+	_txlen = 0;
+	_inFlight = 0;
+}
 
-	lcd.rs = disable;
-	lcd.rw = disable;
-	lcd.data = 0x00;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_us(1);
-	lcd.data = 0x01;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_us(1);
+/*
+ * Timer tick. Submits the slice lcdRefresh() has prepared, one
+ * run per transaction, so nobody waits for the LCD longer than
+ * one slice. The frame is scanned in the loop, not here.
+ */
+static void _service(void)
+{
+	// A hung slice is aborted here, there may be no I2CWait() to do it
+	I2CPoll();
+	if (!_ready || _locked || _inFlight)
+		return;
+
+	_slice.addr = LCD_I2C_ADDR;
+	_slice.flags = 0;
+	_slice.wbuf = _tx;
+	_slice.wlen = _txlen;
+	_slice.rlen = 0;
+	_slice.done = _sliceDone;
+	_ready = 0;
+	_inFlight = 1;
+	_sliceStart = micros();
+	I2CSubmit(&_slice);
+}
 
-	I2CStop();
+/*
+ * Called from the loop. Queues the next glyph or run of changed
+ * chars in _tx once the last slice is through, for the tick.
+ */
+static void lcdRefresh(void)
+{
+	if (!_dirty || _ready || _inFlight)
+		return;
+	if (!I2CPresent(LCD_I2C_ADDR))
+		return;
+
+	if (!_nextGlyph() && !_nextRun()) {
+		_dirty = 0;
+		_lastFrameBytes = _frameBytes;
+		_frameBytes = 0;
+		return;
+	}
+
+	_frameBytes += _txlen;
+	_ready = 1;
+}
+
+static char *lcdFrame(void)
+{
+	return &_frame[0][0];
+}
+
+static void lcdUpdate(void)
+{
+	_dirty = 1;
+}
+
+static void lcdSetGlyphs(const char (*glyphs)[8], uint8_t count)
+{
+	_lock();
+	_glyphs = glyphs;
+	_nglyphs = count < LCD_GLYPH_MAX ? count : LCD_GLYPH_MAX;
+	memset(_slotGlyph, LCD_NO_GLYPH, sizeof(_slotGlyph));
+	_dirty = 1;
+	_unlock();
+}
+
+static void lcdGetStats(struct LCDStats *stats)
+{
+	uint8_t oldSREG = SREG;
+
+	cli();
+	stats->frameBytes = _lastFrameBytes;
+	stats->maxSliceUs = _maxSliceUs;
+	stats->cgramWrites = _cgramWrites;
+	SREG = oldSREG;
+}
+
+static void lcdBacklight(uint8_t sw)
+{
+	_lock();
+	// The backlight is a PCF8574 pin, no E pulse needed
+	lcd.backlight = sw;
+	_put(lcd.value);
+
+	_flush();
+	_unlock();
+}
+
+static void lcdClear(void)
+{
+	_lock();
+	_command(0x01);
+	// The LCD ignores anything sent before Clear display is done
+	_wait(LCD_CLEAR_US);
+	memset(_shadow, ' ', sizeof(_shadow));
+	_unlock();
 }
 
 /**
@@ -208,26 +656,22 @@ static void lcdClear(void)
 
 static void writeCustomChar(const char *custom, uint8_t pos)
 {
-	I2CStart(LCD_I2C_ADDR);
+	uint8_t cgchar;
 
-	uint8_t cgchar = pgm_read_byte(&cgram_char[pos]);
-
-	lcd.rs = disable;
-	lcd.rw = disable;
-	lcd.data = (cgchar >> 4);
-	I2CWriteByte(lcd.value);
-	_strobe();
 	pos &= 0x07;
-	lcd.data = (cgchar & 0x0f);
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_us(1);
+	cgchar = pgm_read_byte(&cgram_char[pos]);
+
+	_lock();
+	// The slot is not the cached glyph's anymore
+	_slotGlyph[pos] = LCD_NO_GLYPH;
+	_command(cgchar);
 
 	for (uint8_t i = 0; i < 8; i++) {
 		_putchar(*(custom + i));
 	}
 
-	I2CStop();
+	_flush();
+	_unlock();
 }
 
 static struct LCD screen = {
@@ -235,65 +679,58 @@ static struct LCD screen = {
 	.clear = lcdClear,
 	.putCustomChar = writeCustomChar,
 	.printString = lcdPrintString,
-	.printChar = lcdPrintChar
+	.printChar = lcdPrintChar,
+	.frame = lcdFrame,
+	.update = lcdUpdate,
+	.refresh = lcdRefresh,
+	.setGlyphs = lcdSetGlyphs,
+	.getStats = lcdGetStats
 };
 
 struct LCD *lcdInit(void)
 {
-	_delay_ms(50);
+	_lock();
+	// Power on time, 40 ms for Vcc down to 2.7 V
+	_delay_ms(40);
 	lcd.value = 0x00;
-
-	I2CStart(LCD_I2C_ADDR);
-
-	lcd.data = 0x03;
-	lcd.rs = disable;
-	lcd.rw = disable;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	_delay_ms(20);
-	_strobe();
-	_delay_ms(5);
-	_strobe();
-	_delay_us(120);
-	_strobe();
-
+	_txlen = 0;
+	// Fixed delays until the busy flag is known to work
+	_noBusyFlag = 1;
+	I2CSetSpeed(LCD_I2C_ADDR, LCD_I2C_SPEED);
+	I2CSetPriority(LCD_I2C_ADDR, I2C_PRIO_DISPLAY);
+
+	// Put the LCD in 8-bit mode whatever state it is in
+	_put(lcd.value);
+	_nibble(0x03);
+	_flush();
+	// The busy flag can't be read until the interface is set
+	_delay_us(4100);
+	_nibble(0x03);
+	_flush();
+	_delay_us(100);
+	_nibble(0x03);
+
+	// Switch to 4-bit mode
+	_nibble(0x02);
 	// Function set
-	lcd.data = 0x02;
-	I2CWriteByte(lcd.value);
-	_strobe();
-
-	lcd.data = 0x02;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	lcd.data = 0x08;
-	I2CWriteByte(lcd.value);
-	_strobe();
-
+	_command(0x28);
 	// Display on/off control
-	lcd.data = 0x00;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	lcd.data = 0x0C;
-	I2CWriteByte(lcd.value);
-	_strobe();
-
-	// Display clear
-	lcd.data = 0x00;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	lcd.data = 0x01;
-	I2CWriteByte(lcd.value);
-	_strobe();
-
+	_command(0x0C);
 	// Entry mode set
-	lcd.data = 0x00;
-	I2CWriteByte(lcd.value);
-	_strobe();
-	lcd.data = 0x06;
-	I2CWriteByte(lcd.value);
-	_strobe();
-
-	I2CStop();
+	_command(0x06);
+	// Display clear
+	_command(0x01);
+	_wait(LCD_CLEAR_US);
+	// Idle now, with the address counter at 0
+	_probeBusyFlag();
+	memset(_shadow, ' ', sizeof(_shadow));
+	// CGRAM is lost on power off
+	memset(_slotGlyph, LCD_NO_GLYPH, sizeof(_slotGlyph));
+
+	// Redraw the frame on the fresh screen in the background
+	_dirty = 1;
+	_unlock();
+	tmr_add_tick(_service);
 
 	return &screen;
 }
@@ -2,6 +2,14 @@
 #define _LCD_H_
 
 #define LCD_I2C_ADDR		0x40
+/*
+ * SCL rate for the PCF8574 backpack. The chip is specified for
+ * 100 kHz; many boards are fine at 400 kHz, define it in the
+ * Makefile to run yours faster.
+ */
+#ifndef LCD_I2C_SPEED
+#define LCD_I2C_SPEED		100000UL
+#endif
 #define enable				1
 #define disable				0
 
@@ -10,11 +18,27 @@
 #else
 	#define NUM_LINES		1
 #endif
+#define LCD_COLS			16
+
+/*
+ * Chars LCD_GLYPH_BASE + n in the frame show glyph n of the set
+ * given to setGlyphs(). The glyphs are loaded to the 8 CGRAM slots
+ * when they are needed, so up to 8 different ones fit on the screen.
+ */
+#define LCD_GLYPH_BASE		0x10
+#define LCD_GLYPH_MAX		16
+
+struct LCDStats {
+	uint16_t frameBytes;	// bytes sent for the last complete frame
+	uint16_t maxSliceUs;	// longest background transfer, us
+	uint16_t cgramWrites;	// glyphs loaded to CGRAM
+};
 
 struct LCD {
 	void (*backlight)(uint8_t sw);
 	void (*clear)(void);
 	void (*putCustomChar)(const char *custom, uint8_t pos);
+	// Write through the frame buffer and to the LCD at once
 #ifdef TWO_LINE_LCD
 	uint8_t (*printChar)(char data, uint8_t line, uint8_t start);
 	uint8_t (*printString)(char *data, uint8_t line, uint8_t start, uint8_t size);
@@ -22,6 +46,21 @@ struct LCD {
 	uint8_t (*printChar)(char data, uint8_t start);
 	uint8_t (*printString)(char *data, uint8_t start, uint8_t size);
 #endif
+	/*
+	 * Frame buffer owned by the driver, NUM_LINES lines of
+	 * LCD_COLS chars each. A line may end early with '\0'.
+	 */
+	char *(*frame)(void);
+	// Mark the frame changed, refresh() sends it
+	void (*update)(void);
+	/*
+	 * Prepare the next slice of a changed frame, call it from the
+	 * loop every ms or so; the timer tick only puts it on the bus.
+	 */
+	void (*refresh)(void);
+	// Glyph set in PROGMEM, 8 bytes each
+	void (*setGlyphs)(const char (*glyphs)[8], uint8_t count);
+	void (*getStats)(struct LCDStats *stats);
 };
 
 struct LCD *lcdInit(void);
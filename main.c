@@ -2,11 +2,13 @@
 #include <avr/wdt.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <avr/power.h>
 #include <util/delay.h>
 #include <string.h>
 #include <stdlib.h>
-#include <stdio.h>
 #include "timer.h"
+#include "fmt.h"
 #include "errorno.h"
 #include "main.h"
 #include "i2c.h"
@@ -17,113 +19,129 @@
 #include "ds3231.h"
 #include "nmea.h"
 #include "dht22.h"
+#include "sched.h"
+#include "prof.h"
+#include "telem.h"
 
 #define BUFFER_SIZE			128
-#define SCREEN_BUFF			16
-#define LCD_EMPTY_LINE		"                "
+#define SCREEN_BUFF			LCD_COLS
+// How often the RTC is set from GPS
+#define TIME_SYNC_MS		60000
+// Pressure samples averaged per reading, ~1 s in the standard mode
+#define PRESSURE_DECIMATION	100
 
-// Buffer with actual data received from UART
+// Last sentence received from UART, for the USB output
 static char wbuf[BUFFER_SIZE];
-// Buffer for temporary data
-static char tbuf[BUFFER_SIZE];
 // Buffer for USB output
 static char ubuf[BUFFER_SIZE];
 /*
- * USB output mask:
+ * USB output, built by sendData():
  *	- \r\n - carriage return, new line
  *	- $DATA - beginning of data section
- *	- %02d:%02d:%02d - hh:mm:ss, time
- *	- %03d - pressure
- *	- %02d - humidity
- *	- %02d.%1d - internal temperature
- *	- %02d.%1d - external temperature
+ *	- hh:mm:ss - time
+ *	- 000 - pressure
+ *	- 00 - humidity
+ *	- 00.0 - internal temperature
+ *	- 00.0 - external temperature
  *	- \r\n - carriage return, new line
  *	- GPS - beginning of GPS output section
- *	- %s - GPS data from receiver
+ *	- GPS data from receiver
  * GPS data always ends with \r\n, so we don't need
  * to add ending chars to the line.
+ * In binary mode sendTelemetry() sends the same as a
+ * TELEM_SAMPLE and a TELEM_NMEA frame, see telem.h.
  */
-#define USB_OUTPUT_MASK		"\r\n$DATA;%02d:%02d:%02d;%03d;%02d;%02d.%1d;%02d.%1d\r\n$GPS;%s"
 
-static uint8_t intCounter = 0;
-// Screen buffer
-#ifdef TWO_LINE_LCD
-	char pbuf[NUM_LINES][SCREEN_BUFF];
-#else
-	char pbuf[SCREEN_BUFF];
-#endif
+// Screen buffer, owned by the LCD driver
+static char (*pbuf)[SCREEN_BUFF];
+
+// Send binary telemetry frames instead of the text lines
+static uint8_t binaryOutput = 0;
 
 static long slPressure = 0;
 static long slTemp = 0;
+static uint16_t dhtHumidity10 = 0;
+static int16_t dhtTemp10 = 0;
+
+/*
+ * Time spent running and sleeping, in ms and the us
+ * not yet carried over
+ */
+struct Duty {
+	uint32_t activeMs;
+	uint32_t sleepMs;
+	uint16_t activeUs;
+	uint16_t sleepUs;
+};
+static struct Duty duty;
+static unsigned long lastWake;
+
+static struct LCD *screen;
+static struct DS3231 *rtc;
+static struct GPS *gps;
+static struct BMP085 *pressSensor;
+static uint8_t pressSensorErr;		// BMP085_init() failed, redone from taskPressure
 
 struct ts rtc_time;
 
 typedef enum {
-	ACTION_WRITE_SCREEN,	// Write data from buffer to the screen
+	ACTION_WRITE_SCREEN,	// Write changes from buffer to the screen
 	ACTION_ERASE_SCREEN		// Erase both, screen and buffer
 } ScreenAction;
 
+/*
+ * The LCD driver sends the changed chars of the buffer in the
+ * background, writing the screen only marks it changed.
+ * Lines shorter than SCREEN_BUFF are padded with blanks.
+ */
 static void writeScreen(struct LCD *screen, ScreenAction flag) {
-#ifdef TWO_LINE_LCD
-	for (uint8_t i = 0; i < NUM_LINES; i++) {
-		if (flag == ACTION_WRITE_SCREEN) {
-			screen->printString(pbuf[i], i, 0, strlen(pbuf[i]));
-			//memset(&pbuf[i], 0x20, SCREEN_BUFF);
-		} else if (flag == ACTION_ERASE_SCREEN) {
-			//memset(&pbuf[i], 0x20, SCREEN_BUFF);
-			memcpy(&pbuf[i], LCD_EMPTY_LINE, SCREEN_BUFF);
-			screen->printString(pbuf[i], i, 0, strlen(pbuf[i]));
-		}
+	if (flag == ACTION_ERASE_SCREEN) {
+		memset(pbuf, 0x00, NUM_LINES * SCREEN_BUFF);
+		screen->clear();
+	} else if (flag == ACTION_WRITE_SCREEN) {
+		screen->update();
 	}
-#else
-	if (flag == ACTION_WRITE_SCREEN) {
-		screen->printString(pbuf, 0, 0, strlen(pbuf));
-		//memset(&pbuf, 0x20, SCREEN_BUFF);
-	} else if (flag == ACTION_ERASE_SCREEN) {
-		for (uint8_t i = 0; i < SCREEN_BUFF; i++) {
-			pbuf[i] = " ";
-		}
-		screen->printString(pbuf, 0, 0, strlen(pbuf));
-    }
-#endif
 }
 
-ISR(USART1_RX_vect) {
-	char tmp = UDR1;
+static struct BMP085 *initPressureSensor(void)
+{
+	struct BMP085 *sensor;
 
-	if (intCounter < BUFFER_SIZE) {
-		if (tmp != '\n') {
-			tbuf[intCounter++] = tmp;
-		} else {
-			tbuf[intCounter] = '\0';
-			intCounter = 0;
-			PORTB &= ~_BV(PB0);
-		}
-	}
+	sensor = BMP085_init(MODE_STANDARD, 0, 1, &pressSensorErr);
+	if (pressSensorErr == ESUCCESS)
+		pressSensorErr = sensor->setLocalAbsAlt(22000);
+	if (pressSensorErr == ESUCCESS)
+		pressSensorErr = sensor->setLocalPressure(740);
+	sensor->startSampling(PRESSURE_DECIMATION);
+
+	return sensor;
 }
 
-/*
- * This function reads custom chars from
- * CPU's Flash memory and returns it to
- * LCD screen
- */
-static void initPgmFont(struct LCD *screen)
+static struct LCD *initScreen(void)
 {
-	for (uint8_t i = 0; i < FONT_COUNT; i++) {
-		char ch[8];
-		for (uint8_t k = 0; k < 8; k++) {
-			ch[k] = pgm_read_byte(&font[i][k]);
-		}
-		screen->putCustomChar((const char *)&ch, i + 1);
-	}
+	struct LCD *screen;
+
+	// Init LCD and fill struct LCD with initial data
+	screen = lcdInit();
+	pbuf = (char (*)[SCREEN_BUFF])screen->frame();
+	// Enable LCD backligt
+	screen->backlight(enable);
+	// Clear LCD screen and its buffer
+	writeScreen(screen, ACTION_ERASE_SCREEN);
+	// Icons in flash, loaded to the LCD when they are on the screen
+	screen->setGlyphs(font, FONT_COUNT);
+
+	return screen;
 }
 
+/*
+ * Set the RTC from GPS, run every TIME_SYNC_MS by the scheduler
+ */
 static uint8_t timeCorrection(struct DS3231 *rtc, struct GPS *gps)
 {
 	struct ts new_time;
 	uint8_t gHours, gMinutes, gSeconds;
 	uint8_t rtcHours, rtcMinutes, rtcSeconds;
-	static uint16_t delay_counter = 0;
 
 	if (!gps->gpsTimeHasFix)
 		return EGPSTIMENOFIX;
@@ -143,51 +161,579 @@ static uint8_t timeCorrection(struct DS3231 *rtc, struct GPS *gps)
 	 * TODO: add DST time correction
 	 * for now it is hardcoded.
 	 */
-	if (++delay_counter > 16000) {
-		if ((gHours + 3) != rtcHours) {
-			if ((gHours + 3) >= 24)
-				new_time.hour = (gHours + 3) - 24;
-			else
-				new_time.hour = gHours + 3;
-		}
+	if ((gHours + 3) != rtcHours) {
+		if ((gHours + 3) >= 24)
+			new_time.hour = (gHours + 3) - 24;
+		else
+			new_time.hour = gHours + 3;
+	}
 
-		if (gMinutes != rtcMinutes)
-			new_time.min = gMinutes;
-		if (gSeconds != rtcSeconds)
-			new_time.sec = gSeconds;
-
-		if (gps->gpsDateHasFix) {
-			if (rtc_time.mday != gps->gpsGetDay())
-				new_time.mday = gps->gpsGetDay();
-			if (rtc_time.mon != gps->gpsGetMonth())
-				new_time.mon = gps->gpsGetMonth();
-			if (rtc_time.year_s != gps->gpsGetYear())
-				new_time.year_s = gps->gpsGetYear();
-		}
-		rtc->set(new_time);
+	if (gMinutes != rtcMinutes)
+		new_time.min = gMinutes;
+	if (gSeconds != rtcSeconds)
+		new_time.sec = gSeconds;
 
-		delay_counter = 0;
+	if (gps->gpsDateHasFix) {
+		if (rtc_time.mday != gps->gpsGetDay())
+			new_time.mday = gps->gpsGetDay();
+		if (rtc_time.mon != gps->gpsGetMonth())
+			new_time.mon = gps->gpsGetMonth();
+		if (rtc_time.year_s != gps->gpsGetYear())
+			new_time.year_s = gps->gpsGetYear();
 	}
+	rtc->set(new_time);
 
 	return ESUCCESS;
 }
 
+/*
+ * In binary mode text, the replies to host commands, goes out in
+ * TELEM_TEXT frames, so it can't be mistaken for part of a frame
+ */
 static void send_usb(char *str)
 {
+	uint8_t frame[TELEM_HEADER + TELEM_MAX_PAYLOAD + TELEM_CRC];
+	uint8_t len;
+
+	if (!binaryOutput) {
+		while (*str) {
+			usb_serial_putchar(*str++);
+		}
+		return;
+	}
+
 	while (*str) {
-		usb_serial_putchar(*str++);
+		len = strnlen(str, TELEM_MAX_PAYLOAD);
+		usb_serial_write(frame, telem_frame(frame, TELEM_TEXT, str, len));
+		str += len;
 	}
 }
 
-int main(void)
+// Terminate the line in ubuf at p and send it
+static void send_ubuf(char *p)
 {
-	struct LCD *screen;
-	struct DS3231 *rtc;
-	struct GPS *gps;
-	struct BMP085 *pressSensor = (struct BMP085 *)malloc(sizeof(struct BMP085));
-	float dht22_humidity = 0L;
-	float dht22_temp = 0L;
+	*p = '\0';
+	send_usb(ubuf);
+}
+
+/*
+ * Copy a line built by the formatter into the screen buffer,
+ * what doesn't fit is cut and the rest is padded with NULs
+ */
+static void setLine(uint8_t n, const char *line, const char *end)
+{
+	uint8_t len = end - line;
+
+	if (len > SCREEN_BUFF)
+		len = SCREEN_BUFF;
+	memcpy(pbuf[n], line, len);
+	memset(&pbuf[n][len], 0x00, SCREEN_BUFF - len);
+}
+
+static void renderScreen(uint8_t satFix, int16_t inTemp10,
+						 uint16_t pressure, uint16_t humidity10,
+						 int16_t outTemp10)
+{
+	char line[SCREEN_BUFF * 2];
+	char *p;
+
+	// Clock, GPS state, inside temperature
+	p = fmt_icon(line, ICO_CLOCK);
+	p = fmt_time(p, rtc_time.hour, rtc_time.min);
+	*p++ = ' ';
+	p = fmt_icon(p, satFix ? ICO_SAT_ONLINE : ICO_SAT_OFFLINE);
+	p = fmt_pstr(p, "  ");
+	p = fmt_icon(p, ICO_TEMP_INSIDE);
+	p = fmt_int(p, inTemp10 / 10, 3, ' ');
+	*p++ = 'C';
+	setLine(0, line, p);
+
+#ifdef TWO_LINE_LCD
+	// Pressure, humidity, outside temperature
+	p = fmt_icon(line, ICO_PRESSURE);
+	p = fmt_uint(p, pressure, 0, ' ');
+	*p++ = ' ';
+	p = fmt_icon(p, ICO_HUMIDITY);
+	p = fmt_uint(p, humidity10 / 10, 2, ' ');
+	p = fmt_pstr(p, "% ");
+	p = fmt_icon(p, ICO_TEMP_OUTSIDE);
+	p = fmt_int(p, outTemp10 / 10, 3, ' ');
+	*p++ = 'C';
+	setLine(1, line, p);
+#endif
+}
+
+static void sendData(uint16_t pressure, uint16_t humidity10,
+					 int16_t inTemp10, int16_t outTemp10)
+{
+	char *p;
+
+	p = fmt_pstr(ubuf, "\r\n$DATA;");
+	p = fmt_time(p, rtc_time.hour, rtc_time.min);
+	*p++ = ':';
+	p = fmt_uint(p, rtc_time.sec, 2, '0');
+	*p++ = ';';
+	p = fmt_uint(p, pressure, 3, '0');
+	*p++ = ';';
+	p = fmt_uint(p, humidity10 / 10, 2, '0');
+	*p++ = ';';
+	p = fmt_tenths(p, inTemp10, 2);
+	*p++ = ';';
+	p = fmt_tenths(p, outTemp10, 2);
+	p = fmt_pstr(p, "\r\n$GPS;");
+	p = fmt_strn(p, wbuf, BUFFER_SIZE - 1 - (p - ubuf));
+	send_ubuf(p);
+}
+
+static void sendTelemetry(int32_t pressure, uint16_t humidity10,
+						  int16_t inTemp10, int16_t outTemp10)
+{
+	struct TelemSample s;
+	uint8_t len;
+
+	s.hour = rtc_time.hour;
+	s.min = rtc_time.min;
+	s.sec = rtc_time.sec;
+	s.flags = (gps->gpsTimeHasFix ? TELEM_FLAG_TIMEFIX : 0) |
+			  (gps->gpsDateHasFix ? TELEM_FLAG_DATEFIX : 0);
+	s.pressure = pressure;
+	s.inTemp10 = inTemp10;
+	s.outTemp10 = outTemp10;
+	s.humidity10 = humidity10;
+	len = telem_frame((uint8_t *)ubuf, TELEM_SAMPLE, &s, sizeof(s));
+	usb_serial_write((uint8_t *)ubuf, len);
+
+	// The sentence without its line end
+	len = strcspn(wbuf, "\r\n");
+	if (len > TELEM_MAX_PAYLOAD)
+		len = TELEM_MAX_PAYLOAD;
+	len = telem_frame((uint8_t *)ubuf, TELEM_NMEA, wbuf, len);
+	usb_serial_write((uint8_t *)ubuf, len);
+}
+
+#ifdef I2C_STATS
+/*
+ * I2C bus statistics, one line per slave:
+ *	$I2C;address;transactions;bytes written;bytes read;NAKs;timeouts;bus us;max us
+ * followed by the longest blocking wait and the presence bitmap:
+ *	$I2CWAIT;us
+ *	$I2CMAP;bitmap
+ */
+static void sendI2CStats(void)
+{
+	struct I2CStats st;
+	char *p;
+
+	for (uint8_t i = 0; I2CStatsGet(i, &st) == ESUCCESS; i++) {
+		p = fmt_pstr(ubuf, "\r\n$I2C;");
+		p = fmt_hex(p, st.addr);
+		*p++ = ';';
+		p = fmt_uint(p, st.xfers, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.wbytes, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.rbytes, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.naks, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.timeouts, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.busUs, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.maxUs, 0, ' ');
+		send_ubuf(p);
+	}
+	p = fmt_pstr(ubuf, "\r\n$I2CWAIT;");
+	p = fmt_uint(p, I2CWorstWait(), 0, ' ');
+	p = fmt_pstr(p, "\r\n$I2CMAP;");
+	p = fmt_hex(p, I2CPresenceMap());
+	p = fmt_pstr(p, "\r\n");
+	send_ubuf(p);
+}
+
+/*
+ * I2C queue statistics, one line per priority class:
+ *	$I2CQ;class;transactions;wait us;max wait us;max depth
+ */
+static void sendI2CQueueStats(void)
+{
+	struct I2CQueueStats qs;
+	char *p;
+
+	for (uint8_t i = 0; I2CQueueStatsGet(i, &qs) == ESUCCESS; i++) {
+		p = fmt_pstr(ubuf, "\r\n$I2CQ;");
+		p = fmt_uint(p, i, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, qs.xfers, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, qs.waitUs, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, qs.maxWaitUs, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, qs.maxDepth, 0, ' ');
+		send_ubuf(p);
+	}
+	send_usb("\r\n");
+}
+#endif
+
+static void addTime(uint32_t *ms, uint16_t *rest, unsigned long us)
+{
+	us += *rest;
+	*ms += us / 1000;
+	*rest = us % 1000;
+}
+
+/*
+ * Sleep until the next interrupt. Timer0 has to keep running
+ * for millis(), so idle is the deepest mode we can use; it
+ * overflows every ~1 ms, the USART and USB wake us up as well.
+ */
+static void idle(void)
+{
+	unsigned long sleepStart;
+
+	sleepStart = micros();
+	addTime(&duty.activeMs, &duty.activeUs, sleepStart - lastWake);
+
+	cli();
+	sleep_enable();
+	// sei() takes effect after sleep_cpu(), no wake up is lost
+	sei();
+	sleep_cpu();
+	sleep_disable();
 
+	lastWake = micros();
+	addTime(&duty.sleepMs, &duty.sleepUs, lastWake - sleepStart);
+}
+
+/*
+ * Active and sleep time since the last reset, and the active
+ * part of it in per mille:
+ *	$DUTY;active ms;sleep ms;active permille
+ */
+static void sendDuty(void)
+{
+	uint32_t active = duty.activeMs;
+	uint32_t total = duty.activeMs + duty.sleepMs;
+	char *p;
+
+	// Keep active * 1000 in 32 bits
+	while (total > 4000000UL) {
+		active >>= 1;
+		total >>= 1;
+	}
+
+	p = fmt_pstr(ubuf, "\r\n$DUTY;");
+	p = fmt_uint(p, duty.activeMs, 0, ' ');
+	*p++ = ';';
+	p = fmt_uint(p, duty.sleepMs, 0, ' ');
+	*p++ = ';';
+	p = fmt_uint(p, total ? active * 1000 / total : 1000, 0, ' ');
+	p = fmt_pstr(p, "\r\n");
+	send_ubuf(p);
+}
+
+/*
+ * GPS sentences queued by the UART, dropped because the ring
+ * was full or they were too long, and the deepest queue seen:
+ *	$NMEA;sentences;overruns;too long;max depth
+ */
+static void sendNmeaStats(void)
+{
+	struct USARTStats s;
+	char *p;
+
+	USART_getStats(&s);
+	p = fmt_pstr(ubuf, "\r\n$NMEA;");
+	p = fmt_uint(p, s.sentences, 0, ' ');
+	*p++ = ';';
+	p = fmt_uint(p, s.overruns, 0, ' ');
+	*p++ = ';';
+	p = fmt_uint(p, s.truncated, 0, ' ');
+	*p++ = ';';
+	p = fmt_uint(p, s.maxDepth, 0, ' ');
+	p = fmt_pstr(p, "\r\n");
+	send_ubuf(p);
+}
+
+#ifdef PROFILE
+/*
+ * Profiler, one line per stage:
+ *	$PROF;stage;count;min us;avg us;max us;histogram
+ * The histogram has PROF_HIST_BUCKETS counts separated by ',',
+ * bucket n counts runs under PROF_HIST_MIN_US << n us.
+ */
+static void sendProfile(void)
+{
+	struct ProfStage st;
+	char *p;
+
+	for (uint8_t i = 0; prof_get(i, &st) == ESUCCESS; i++) {
+		p = fmt_pstr(ubuf, "\r\n$PROF;");
+		p = fmt_str_P(p, prof_name(i));
+		*p++ = ';';
+		p = fmt_uint(p, st.count, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.minUs, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.count ? st.totalUs / st.count : 0, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, st.maxUs, 0, ' ');
+		for (uint8_t n = 0; n < PROF_HIST_BUCKETS; n++) {
+			*p++ = n ? ',' : ';';
+			p = fmt_uint(p, st.hist[n], 0, ' ');
+		}
+		send_ubuf(p);
+	}
+	send_usb("\r\n");
+}
+#endif
+
+/*
+ * Scheduler statistics, one line per task:
+ *	$TASK;id;runs;overruns;total us;max us
+ */
+static void sendTaskStats(void)
+{
+	struct Task *t;
+	char *p;
+
+	for (uint8_t i = 0; (t = sched_get(i)); i++) {
+		p = fmt_pstr(ubuf, "\r\n$TASK;");
+		*p++ = t->id;
+		*p++ = ';';
+		p = fmt_uint(p, t->runs, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, t->overruns, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, t->totalUs, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, t->maxUs, 0, ' ');
+		send_ubuf(p);
+	}
+	send_usb("\r\n");
+}
+
+/*
+ * Commands from the host, one char each:
+ *	- f - dump loop profile (PROFILE builds)
+ *	- F - reset loop profile (PROFILE builds)
+ *	- p - dump active/sleep time
+ *	- P - reset active/sleep time
+ *	- t - dump task statistics
+ *	- T - reset task statistics
+ *	- n - dump GPS sentence queue statistics
+ *	- N - reset GPS sentence queue statistics
+ *	- l - bytes sent to the LCD for the last screen update,
+ *	  the longest background LCD transfer and the number of
+ *	  icons loaded to CGRAM so far:
+ *	  $LCD;bytes;max us;CGRAM writes
+ *	- i - dump I2C bus statistics
+ *	- q - dump I2C queue statistics
+ *	- I - reset I2C bus and queue statistics
+ *	- b - send binary telemetry frames, see telem.h, the replies
+ *	  to the other commands come in TELEM_TEXT frames then
+ *	- a - send the text lines (default)
+ */
+static void processCommand(struct LCD *screen)
+{
+	struct LCDStats lcdStats;
+	char *p;
+
+	switch (usb_serial_getchar()) {
+#ifdef PROFILE
+	case 'f':
+		sendProfile();
+		break;
+	case 'F':
+		prof_reset();
+		break;
+#endif
+	case 'p':
+		sendDuty();
+		break;
+	case 'P':
+		memset(&duty, 0, sizeof(duty));
+		break;
+	case 'b':
+		binaryOutput = 1;
+		break;
+	case 'a':
+		binaryOutput = 0;
+		break;
+	case 't':
+		sendTaskStats();
+		break;
+	case 'T':
+		sched_reset_stats();
+		break;
+	case 'n':
+		sendNmeaStats();
+		break;
+	case 'N':
+		USART_resetStats();
+		break;
+	case 'l':
+		screen->getStats(&lcdStats);
+		p = fmt_pstr(ubuf, "\r\n$LCD;");
+		p = fmt_uint(p, lcdStats.frameBytes, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, lcdStats.maxSliceUs, 0, ' ');
+		*p++ = ';';
+		p = fmt_uint(p, lcdStats.cgramWrites, 0, ' ');
+		p = fmt_pstr(p, "\r\n");
+		send_ubuf(p);
+		break;
+#ifdef I2C_STATS
+	case 'i':
+		sendI2CStats();
+		break;
+	case 'q':
+		sendI2CQueueStats();
+		break;
+	case 'I':
+		I2CStatsReset();
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+/*
+ * Tasks, run by the scheduler when due. The sensors are read
+ * at the rate their values change, the rest of the time the
+ * loop serves the host and the GPS.
+ */
+static void taskHost(void)
+{
+	// Process usb configuration (not being in the while loop).
+	// while (!usb_configured()) /* wait */
+	usb_configured();
+	// Serve requests from the host
+	processCommand(screen);
+}
+
+static void taskReprobe(void)
+{
+	// Bring back i2c devices plugged in after boot
+	switch (I2CReprobe()) {
+	case BMP085_ADDR:
+		pressSensor = initPressureSensor();
+		break;
+	case DS3231_I2C_ADDR:
+		rtc = DS3231_init(DS3231_INTCN);
+		break;
+	case LCD_I2C_ADDR:
+		screen = initScreen();
+		break;
+	default:
+		break;
+	}
+}
+
+static void taskGps(void)
+{
+	char *s;
+
+	// Turn off UART's led
+	PORTB |= _BV(PB0);
+	PROF_BEGIN(PROF_GPS);
+	// Process every GPS sentence received from UART since the last run
+	while ((s = USART_getSentence())) {
+		gps->parse(s);
+		strcpy(wbuf, s);
+		USART_releaseSentence();
+		PORTB &= ~_BV(PB0);
+	}
+	PROF_END(PROF_GPS);
+}
+
+static void taskClock(void)
+{
+	PROF_BEGIN(PROF_RTC);
+	// Update current time from RTC module, keeps the last one on error
+	rtc->get(&rtc_time);
+	PROF_END(PROF_RTC);
+}
+
+static void taskTimeSync(void)
+{
+	// Update time in RTC clock
+	timeCorrection(rtc, gps);
+}
+
+/*
+ * Update pressure/temperature from BMP085 sensor. It samples in
+ * the background, this only takes the averaged readings.
+ */
+static void taskPressure(void)
+{
+	PROF_BEGIN(PROF_BMP085);
+	// The sensor is there but did not get through the init, try again
+	if (pressSensorErr != ESUCCESS && I2CPresent(BMP085_ADDR))
+		pressSensor = initPressureSensor();
+	// keeps the last values until there is a new reading
+	pressSensor->readSampled(&slTemp, &slPressure);
+	PROF_END(PROF_BMP085);
+}
+
+static void taskHumidity(void)
+{
+	PROF_BEGIN(PROF_DHT22);
+	// Read data from DHT22 sensor, keep the last values on error
+	dht22_read(&dhtTemp10, &dhtHumidity10);
+	PROF_END(PROF_DHT22);
+}
+
+static void taskScreen(void)
+{
+	PROF_BEGIN(PROF_LCD);
+	renderScreen(gps->gpsTimeHasFix, slTemp, slPressure,
+				 dhtHumidity10, dhtTemp10);
+	// Write changed data to LCD screen
+	writeScreen(screen, ACTION_WRITE_SCREEN);
+	PROF_END(PROF_LCD);
+}
+
+// Feed the changed chars to the LCD a slice at a time
+static void taskLcdRefresh(void)
+{
+	screen->refresh();
+}
+
+static void taskReport(void)
+{
+	// Turn off 1-wire's led
+	PORTD |= _BV(PD5);
+	PROF_BEGIN(PROF_USB);
+	if (binaryOutput)
+		sendTelemetry(slPressure, dhtHumidity10, slTemp, dhtTemp10);
+	else
+		sendData(slPressure, dhtHumidity10, slTemp, dhtTemp10);
+	PROF_END(PROF_USB);
+	// Show activity on TX LED
+	PORTD &= ~_BV(PD5);
+}
+
+// id, function, period ms, deadline ms
+static struct Task tasks[] = {
+	{ 'h', taskHost, 10, 10 },
+	{ 'r', taskReprobe, 100, 50 },
+	{ 'g', taskGps, 20, 50 },
+	{ 'c', taskClock, 500, 100 },
+	{ 's', taskTimeSync, TIME_SYNC_MS, 1000 },
+	{ 'p', taskPressure, 250, 100 },
+	// DHT22 needs 2 s between reads, a run up to the deadline late keeps that
+	{ 'd', taskHumidity, 2200, 200 },
+	{ 'l', taskScreen, 500, 100 },
+	{ 'w', taskLcdRefresh, 1, 5 },
+	{ 'u', taskReport, 1000, 200 },
+};
+
+int main(void)
+{
 	// WatchDog configuration
 	wdt_enable(WDTO_2S);
 	wdt_reset();
@@ -210,13 +756,29 @@ int main(void)
 	PORTE &= ~_BV(PE6); // GND
 	DDRD |= _BV(PD7);
 	PORTD |= _BV(PD7);	// PWR
+	/*
+	 * Stop the clock of what we don't use, it keeps
+	 * drawing current in idle sleep otherwise
+	 */
+	ACSR |= _BV(ACD);
+	power_adc_disable();
+	power_spi_disable();
+	power_timer1_disable();
+	power_timer3_disable();
+	power_timer4_disable();
+	set_sleep_mode(SLEEP_MODE_IDLE);
 
 	// Init i2c bus first, as screen, some sensors, use it to communicate
 	I2CInit();
+	/*
+	 * Find out which devices are on the bus. The missing ones
+	 * are skipped by their drivers and looked for from the loop.
+	 */
+	I2CProbe(DS3231_I2C_ADDR);
+	I2CProbe(BMP085_ADDR);
+	I2CProbe(LCD_I2C_ADDR);
 	// Init pressure/temperature sensor
-	pressSensor = BMP085_init(MODE_STANDARD, 0, 1);
-	pressSensor->setLocalAbsAlt(22000);
-	pressSensor->setLocalPressure(740);
+	pressSensor = initPressureSensor();
 	// Init RTC
 	rtc = DS3231_init(DS3231_INTCN);
 	memset(&rtc_time, 0, sizeof(struct ts));
@@ -231,74 +793,18 @@ int main(void)
 	usb_init();
 	usb_serial_flush_input();
 	usb_serial_flush_output();
-	// Init LCD and fill struct LCD with initial data
-	screen = lcdInit();
-	// Enable LCD backligt
-	screen->backlight(enable);
-	// Clear LCD screen and its buffer
-	writeScreen(screen, ACTION_ERASE_SCREEN);
-	// Init custom font chars from flash
-	initPgmFont(screen);
+	// Init LCD
+	screen = initScreen();
+	// Init task scheduler
+	sched_init(tasks, ARRAY_SIZE(tasks));
+	lastWake = micros();
 	// Start forever loop
 	while (1) {
-		// Process usb configuration (not being in the while loop).
-		// while (!usb_configured()) /* wait */
-		usb_configured();
-		// Reset Watchdog timer
+		// Reset Watchdog timer, we never sleep longer than a timer tick
 		wdt_reset();
-		// Turn off UART's led
-		PORTB |= _BV(PB0);
-		// Turn off 1-wire's led
-		PORTD |= _BV(PD5);
-		// Fill receive buffer
-		strcpy(wbuf, tbuf);
-		// Call to process GPS data received from UART
-		gps->parse(wbuf);
-		// Update current time from RTC module
-		memset(&rtc_time, 0, sizeof(struct ts));
-		rtc->get(&rtc_time);
-		// Update pressure/temperature from BMP085 sensor
-		pressSensor->getPressure(&slPressure);
-		pressSensor->getTemperature(&slTemp);
-		// Update time in RTC clock
-		timeCorrection(rtc, gps);
-		/*
-		 * Read data from DHT22 sensor.
-		 * We don't process errors here. Just show
-		 * correct data ignoring the rest.
-		 */
-		dht22_read(&dht22_temp, &dht22_humidity);
-		/*
-		 * Clear screen/buffer before writing data
-		 * so we make sure we always write to an
-		 * empty screen buffer.
-		 */
-		writeScreen(screen, ACTION_ERASE_SCREEN);
-		snprintf(pbuf[0], SCREEN_BUFF, "%c%02d:%02d %c  %c%3dC",
-				ICO_CLOCK, rtc_time.hour, rtc_time.min,
-				(gps->gpsTimeHasFix) ? ICO_SAT_ONLINE : ICO_SAT_OFFLINE,
-				ICO_TEMP_INSIDE, (int16_t)(slTemp * 0.1));
-		snprintf(pbuf[1], SCREEN_BUFF, "%c%d %c%2d%% %c%3dC",
-				ICO_PRESSURE, (uint16_t)slPressure,
-				ICO_HUMIDITY, (uint16_t)dht22_humidity,
-				ICO_TEMP_OUTSIDE, (int16_t)dht22_temp);
-
-		// Write actual data to LCD screen
-		writeScreen(screen, ACTION_WRITE_SCREEN);
-
-		memset(&ubuf, 0x00, BUFFER_SIZE);
-		
-		//send_usb(ubuf);
-		snprintf(ubuf, BUFFER_SIZE, USB_OUTPUT_MASK,
-				 rtc_time.hour, rtc_time.min, rtc_time.sec,
-				 (uint16_t)slPressure, (uint16_t)dht22_humidity,
-				 (int16_t)(slTemp * 0.1), (uint16_t)(slTemp % 10),
-				 (int16_t)dht22_temp, (uint16_t)(dht22_temp) % 10,
-				 wbuf);
-		send_usb(ubuf);
-
-		// Show activity on TX LED
-		PORTD &= ~_BV(PD5);
+		// Run the tasks which are due, sleep if none is due right now
+		if (sched_run())
+			idle();
 	}
 
 	return 0;
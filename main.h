@@ -2,19 +2,29 @@
 #define _MAIN_H_
 
 #include <avr/pgmspace.h>
+#include "lcd.h"
 
-#define FONT_COUNT				7
+#define FONT_COUNT				12
 #define ARRAY_SIZE(x)			((sizeof(x)) / sizeof(x[0]))
 #define CPU_PRESCALE(n)			(CLKPR = 0x80, CLKPR = (n))
 
+/*
+ * Icons are printed to the screen buffer as chars, the LCD
+ * driver loads them to CGRAM when they show up
+ */
 enum {
-	ICO_TEMP_INSIDE		= 1,
+	ICO_TEMP_INSIDE		= LCD_GLYPH_BASE,
 	ICO_TEMP_OUTSIDE,
 	ICO_CLOCK,
 	ICO_PRESSURE,
 	ICO_HUMIDITY,
 	ICO_SAT_ONLINE,
-	ICO_SAT_OFFLINE
+	ICO_SAT_OFFLINE,
+	ICO_WIND,
+	ICO_RAIN,
+	ICO_BATTERY,
+	ICO_TREND_UP,
+	ICO_TREND_DOWN
 };
 
 const char font[FONT_COUNT][8] PROGMEM = {
@@ -38,6 +48,21 @@ const char font[FONT_COUNT][8] PROGMEM = {
 	},
 	{
 		0x0a, 0x1f, 0x0f, 0x0d, 0x13, 0x1b, 0x1c, 0x1f	// SAT off-line,	7
+	},
+	{
+		0x00, 0x1C, 0x02, 0x1D, 0x00, 0x1E, 0x01, 0x06	// Wind,			8
+	},
+	{
+		0x04, 0x0E, 0x1F, 0x1F, 0x00, 0x0A, 0x00, 0x15	// Rain,			9
+	},
+	{
+		0x0E, 0x1B, 0x11, 0x11, 0x1F, 0x1F, 0x1F, 0x1F	// Battery,			10
+	},
+	{
+		0x04, 0x0E, 0x15, 0x04, 0x04, 0x04, 0x04, 0x00	// Trend up,		11
+	},
+	{
+		0x00, 0x04, 0x04, 0x04, 0x04, 0x15, 0x0E, 0x04	// Trend down,		12
 	}
 };
 
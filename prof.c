@@ -0,0 +1,65 @@
+#ifdef PROFILE
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "prof.h"
+#include "errorno.h"
+
+static struct ProfStage _stages[PROF_COUNT];
+
+static const char _gps[] PROGMEM = "gps";
+static const char _rtc[] PROGMEM = "rtc";
+static const char _bmp085[] PROGMEM = "bmp085";
+static const char _dht22[] PROGMEM = "dht22";
+static const char _lcd[] PROGMEM = "lcd";
+static const char _usb[] PROGMEM = "usb";
+
+static const char *const _names[PROF_COUNT] PROGMEM = {
+	[PROF_GPS] = _gps,
+	[PROF_RTC] = _rtc,
+	[PROF_BMP085] = _bmp085,
+	[PROF_DHT22] = _dht22,
+	[PROF_LCD] = _lcd,
+	[PROF_USB] = _usb
+};
+
+void prof_record(uint8_t id, uint32_t us)
+{
+	struct ProfStage *st = &_stages[id];
+	uint32_t limit = PROF_HIST_MIN_US;
+	uint8_t n = 0;
+
+	if (st->count == 0 || us < st->minUs)
+		st->minUs = us;
+	if (us > st->maxUs)
+		st->maxUs = us;
+	st->totalUs += us;
+	st->count++;
+
+	while (n < PROF_HIST_BUCKETS - 1 && us >= limit) {
+		limit <<= 1;
+		n++;
+	}
+	st->hist[n]++;
+}
+
+// Name of a stage, in flash
+const char *prof_name(uint8_t id)
+{
+	return (const char *)pgm_read_word(&_names[id]);
+}
+
+uint8_t prof_get(uint8_t id, struct ProfStage *stage)
+{
+	if (id >= PROF_COUNT)
+		return ENULLPOINTER;
+	*stage = _stages[id];
+
+	return ESUCCESS;
+}
+
+void prof_reset(void)
+{
+	for (uint8_t i = 0; i < PROF_COUNT; i++)
+		_stages[i] = (struct ProfStage){ 0 };
+}
+#endif
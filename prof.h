@@ -0,0 +1,49 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <inttypes.h>
+
+/*
+ * Loop profiler. Wrap a stage with PROF_BEGIN(PROF_x) and
+ * PROF_END(PROF_x) in the same block; both compile to nothing
+ * unless PROFILE is defined.
+ */
+enum {
+	PROF_GPS,
+	PROF_RTC,
+	PROF_BMP085,
+	PROF_DHT22,
+	PROF_LCD,
+	PROF_USB,
+	PROF_COUNT
+};
+
+#ifdef PROFILE
+/*
+ * Histogram bucket n counts the runs shorter than
+ * PROF_HIST_MIN_US << n us, the last one everything longer
+ */
+#define PROF_HIST_BUCKETS	12
+#define PROF_HIST_MIN_US	16
+
+struct ProfStage {
+	uint16_t count;
+	uint32_t minUs;
+	uint32_t maxUs;
+	uint32_t totalUs;
+	uint16_t hist[PROF_HIST_BUCKETS];
+};
+
+#define PROF_BEGIN(id)		unsigned long _prof_##id = micros()
+#define PROF_END(id)		prof_record((id), micros() - _prof_##id)
+
+void prof_record(uint8_t id, uint32_t us);
+const char *prof_name(uint8_t id);
+uint8_t prof_get(uint8_t id, struct ProfStage *stage);
+void prof_reset(void);
+#else
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+#endif
+
+#endif /* _PROF_H_ */
@@ -0,0 +1,80 @@
+#include <stddef.h>
+#include "sched.h"
+#include "timer.h"
+
+static struct Task *_tasks;
+static uint8_t _ntasks;
+
+void sched_init(struct Task *tasks, uint8_t count)
+{
+	unsigned long now = millis();
+
+	_tasks = tasks;
+	_ntasks = count;
+	// Everything runs once on the first pass
+	for (uint8_t i = 0; i < count; i++)
+		tasks[i].due = now;
+	sched_reset_stats();
+}
+
+/*
+ * Run the tasks which are due, in table order. Returns the ms
+ * until the next one is due, 0 if a task runs on every pass.
+ */
+unsigned long sched_run(void)
+{
+	unsigned long now, start, next = (unsigned long)-1;
+	uint32_t us;
+	struct Task *t;
+
+	for (uint8_t i = 0; i < _ntasks; i++) {
+		t = &_tasks[i];
+		now = millis();
+		if ((long)(now - t->due) < 0) {
+			if (t->due - now < next)
+				next = t->due - now;
+			continue;
+		}
+
+		start = micros();
+		t->run();
+		us = micros() - start;
+
+		t->runs++;
+		t->totalUs += us;
+		if (us > t->maxUs)
+			t->maxUs = us > 0xFFFF ? 0xFFFF : us;
+		if ((millis() - t->due) > t->deadline)
+			t->overruns++;
+
+		/*
+		 * Keep the rate, unless we are a whole period behind.
+		 * Missed runs are dropped rather than run back to back.
+		 */
+		t->due += t->period;
+		if ((long)(millis() - t->due) >= 0)
+			t->due = millis() + t->period;
+		if (t->period < next)
+			next = t->period;
+	}
+
+	return next;
+}
+
+struct Task *sched_get(uint8_t n)
+{
+	if (n >= _ntasks)
+		return NULL;
+
+	return &_tasks[n];
+}
+
+void sched_reset_stats(void)
+{
+	for (uint8_t i = 0; i < _ntasks; i++) {
+		_tasks[i].runs = 0;
+		_tasks[i].overruns = 0;
+		_tasks[i].totalUs = 0;
+		_tasks[i].maxUs = 0;
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <inttypes.h>
+
+/*
+ * A task runs every period ms, 0 runs it on every pass of the
+ * loop. It is late (an overrun) when it is not done deadline ms
+ * after it was due.
+ */
+struct Task {
+	char id;					// one char name for the statistics
+	void (*run)(void);
+	uint16_t period;			// ms
+	uint16_t deadline;			// ms
+	// Used by the scheduler
+	unsigned long due;			// millis() of the next run
+	// Statistics
+	uint16_t runs;
+	uint16_t overruns;
+	uint32_t totalUs;			// cumulative run time, us
+	uint16_t maxUs;				// longest run, us
+};
+
+void sched_init(struct Task *tasks, uint8_t count);
+unsigned long sched_run(void);
+struct Task *sched_get(uint8_t n);
+void sched_reset_stats(void);
+
+#endif /* _SCHED_H_ */
@@ -0,0 +1,40 @@
+#include <string.h>
+#include <util/crc16.h>
+#include "telem.h"
+#include "timer.h"
+
+static uint8_t _seq;
+
+/*
+ * Build a frame around len bytes of payload in buf, which must
+ * hold TELEM_HEADER + len + TELEM_CRC bytes. Returns the frame
+ * length, 0 if the payload is too long.
+ */
+uint8_t telem_frame(uint8_t *buf, uint8_t type,
+					const void *payload, uint8_t len)
+{
+	unsigned long now = millis();
+	uint16_t crc = 0xFFFF;
+	uint8_t n;
+
+	if (len > TELEM_MAX_PAYLOAD)
+		return 0;
+
+	buf[0] = TELEM_SYNC;
+	buf[1] = type;
+	buf[2] = len;
+	buf[3] = _seq++;
+	for (n = 4; n < TELEM_HEADER; n++) {
+		buf[n] = now;
+		now >>= 8;
+	}
+	memcpy(&buf[TELEM_HEADER], payload, len);
+	n = TELEM_HEADER + len;
+
+	for (uint8_t i = 1; i < n; i++)
+		crc = _crc_ccitt_update(crc, buf[i]);
+	buf[n++] = crc;
+	buf[n++] = crc >> 8;
+
+	return n;
+}
@@ -0,0 +1,52 @@
+#ifndef _TELEM_H_
+#define _TELEM_H_
+
+#include <inttypes.h>
+
+/*
+ * Binary telemetry frames, sent over USB instead of the text
+ * lines when the host selects them (the 'b' command):
+ *
+ *	0	sync, TELEM_SYNC
+ *	1	type, TELEM_*
+ *	2	length of the payload, n
+ *	3	sequence number, +1 for every frame sent
+ *	4	timestamp, millis(), 4 bytes
+ *	8	payload, n bytes
+ *	8+n	CRC-16 of bytes 1..7+n, 2 bytes
+ *
+ * The CRC is the one of avr-libc _crc_ccitt_update(): polynomial
+ * 0x1021 taken LSB first (0x8408), initial value 0xFFFF, no final
+ * XOR (CRC-16/MCRF4XX). Multi-byte values are little-endian.
+ * A gap in the sequence numbers tells the host how many frames
+ * were lost, a CRC mismatch makes it look for the next sync byte.
+ * tools/telemdec.c is the reference decoder, "make test" runs
+ * frames through it and checks them against this layout.
+ */
+#define TELEM_SYNC			0xA5
+#define TELEM_HEADER		8
+#define TELEM_CRC			2
+#define TELEM_MAX_PAYLOAD	118		// a whole frame fits in 128 bytes
+
+// Frame types
+#define TELEM_SAMPLE		0x01	// struct TelemSample
+#define TELEM_NMEA			0x02	// last GPS sentence, without CR/LF
+#define TELEM_TEXT			0x03	// reply to a host command, as in text mode
+
+#define TELEM_FLAG_TIMEFIX	0x01	// GPS time is valid
+#define TELEM_FLAG_DATEFIX	0x02	// GPS date is valid
+
+// Sensor readings in fixed point, the same values as the $DATA line
+struct TelemSample {
+	uint8_t hour, min, sec;		// RTC time
+	uint8_t flags;				// TELEM_FLAG_*
+	int32_t pressure;			// BMP085 pressure, as on the screen
+	int16_t inTemp10;			// inside temperature, 0.1 C
+	int16_t outTemp10;			// outside temperature, 0.1 C
+	uint16_t humidity10;		// relative humidity, 0.1 %
+};
+
+uint8_t telem_frame(uint8_t *buf, uint8_t type,
+					const void *payload, uint8_t len);
+
+#endif /* _TELEM_H_ */
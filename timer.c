@@ -19,6 +19,8 @@
 volatile unsigned long timer0_overflow_count = 0;
 volatile unsigned long timer0_millis = 0;
 static unsigned char timer0_fract = 0;
+// Called from the overflow handler, every ~1 ms
+static void (*volatile timer0_tick[TMR_TICKS])(void);
 
 ISR(TIMER0_OVF_vect) {
 	// copy these to local variables so they can be stored in registers
@@ -36,6 +38,36 @@ ISR(TIMER0_OVF_vect) {
 	timer0_fract = f;
 	timer0_millis = m;
 	timer0_overflow_count++;
+
+	for (uint8_t i = 0; i < TMR_TICKS; i++) {
+		if (timer0_tick[i])
+			timer0_tick[i]();
+	}
+}
+
+/*
+ * Hook a function to the timer tick, up to TMR_TICKS of them, a
+ * function already hooked is not added twice. It runs in the
+ * interrupt context, so it must be short and must not wait for
+ * anything. Returns 0 when all the slots are taken.
+ */
+uint8_t tmr_add_tick(void (*tick)(void))
+{
+	uint8_t oldSREG = SREG;
+	uint8_t i;
+
+	cli();
+	for (i = 0; i < TMR_TICKS; i++) {
+		if (timer0_tick[i] == tick)
+			break;
+		if (!timer0_tick[i]) {
+			timer0_tick[i] = tick;
+			break;
+		}
+	}
+	SREG = oldSREG;
+
+	return i < TMR_TICKS;
 }
 
 unsigned long millis(void)
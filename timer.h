@@ -1,7 +1,13 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
+#include <inttypes.h>
+
+// Functions which can be hooked to the timer tick
+#define TMR_TICKS		2
+
 void tmr_init(void);
+uint8_t tmr_add_tick(void (*tick)(void));
 unsigned long millis(void);
 unsigned long micros(void);
 
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <math.h>
+
+/*
+ * The fixed-point barometric math of bmp085.c against the float
+ * formulas it replaces. The driver is compiled in whole to reach its
+ * static functions, the bus and the timer are stubbed out; no sensor
+ * readings are involved.
+ */
+#include "bmp085.c"
+
+#define CHECK(c)	_check((c), #c, __LINE__)
+
+volatile uint8_t _hostSREG;
+static int _failed;
+
+// Bus and timer, the math under test never gets this far
+uint8_t I2CSetSpeed(uint8_t addr, uint32_t scl) { return ESUCCESS; }
+uint8_t I2CSetPriority(uint8_t addr, uint8_t prio) { return ESUCCESS; }
+uint8_t I2CPresent(uint8_t addr) { return 0; }
+uint8_t I2CSubmit(struct I2CXfer *xfer) { return EI2CNODEV; }
+void I2CPoll(void) { }
+uint8_t I2CWriteBuf(uint8_t addr, const uint8_t *buf, uint8_t len) { return EI2CNODEV; }
+uint8_t I2CWriteThenRead(uint8_t addr, const uint8_t *wbuf, uint8_t wlen,
+						 uint8_t *rbuf, uint8_t rlen) { return EI2CNODEV; }
+uint8_t tmr_add_tick(void (*tick)(void)) { return ESUCCESS; }
+unsigned long micros(void) { return 0; }
+unsigned long millis(void) { return 0; }
+
+static void _check(int ok, const char *what, int line)
+{
+	if (!ok) {
+		printf("bmp085test.c:%d: FAIL %s\n", line, what);
+		_failed++;
+	}
+}
+
+// log2() and 2^x against libm, relative errors
+static void _testLog(void)
+{
+	double e, log2Err = 0, exp2Err = 0;
+
+	for (uint32_t x = 1; x < 0x7FFFFFFF / 3; x = x * 3 / 2 + 1) {
+		e = fabs(_log2(x) / (double)(1UL << LOG_FRAC_BITS) - log2(x));
+		if (e > log2Err)
+			log2Err = e;
+	}
+	// from 2^24 on, so the rounding to an integer does not count
+	for (int32_t y = 24L << LOG_FRAC_BITS; y < 31L << LOG_FRAC_BITS; y += 997) {
+		double ref = exp2(y / (double)(1UL << LOG_FRAC_BITS));
+
+		e = fabs(_exp2(y) - ref) / ref;
+		if (e > exp2Err)
+			exp2Err = e;
+	}
+	printf("log2() %.3e, 2^x %.3e\n", log2Err, exp2Err);
+	CHECK(log2Err < 2.2e-6);
+	CHECK(exp2Err < 1.7e-6);
+}
+
+/*
+ * Altitude in cm over 300..1100 hPa. The low datums put the higher
+ * pressures past the end of the table, on the log domain formula.
+ */
+static void _testAltitude(void)
+{
+	static const int32_t datum[] = { 60000, 74000, 88000, 101325, 120000 };
+	double ref, e, tableErr = 0, formulaErr = 0;
+	int32_t u;
+
+	for (uint8_t i = 0; i < sizeof(datum) / sizeof(datum[0]); i++) {
+		for (int32_t p = 30000; p <= 110000; p += 7) {
+			ref = 4433000.0 * (1 - pow((double)p / datum[i], 0.1903));
+			u = _log2(p) - _log2(datum[i]);
+			e = fabs(altitude(u) - ref);
+			if (u >= ALT_TABLE_MIN && (u - ALT_TABLE_MIN) >> ALT_TABLE_SHIFT < ALT_TABLE_SIZE - 1) {
+				if (e > tableErr)
+					tableErr = e;
+			} else if (e > formulaErr) {
+				formulaErr = e;
+			}
+		}
+	}
+	printf("altitude: table %.1f cm, formula %.1f cm\n", tableErr, formulaErr);
+	CHECK(tableErr <= 8);
+	CHECK(formulaErr <= 12);
+}
+
+/*
+ * The 740 Pa datum main.c sets: 300..1100 hPa are 5.3..7.2 octaves
+ * above it, all on the log domain formula, 45..71 km below the datum,
+ * where the same relative error is more centimeters.
+ */
+static void _testLowDatum(void)
+{
+	const int32_t datum = 740;
+	double ref, e, err = 0;
+	int32_t u;
+
+	for (int32_t p = 30000; p <= 110000; p += 7) {
+		ref = 4433000.0 * (1 - pow((double)p / datum, 0.1903));
+		u = _log2(p) - _log2(datum);
+		CHECK((u - ALT_TABLE_MIN) >> ALT_TABLE_SHIFT >= ALT_TABLE_SIZE - 1);
+		e = fabs(altitude(u) - ref);
+		if (e > err)
+			err = e;
+	}
+	printf("altitude, 740 Pa datum: %.1f cm\n", err);
+	CHECK(err <= 30);
+}
+
+// Sea level pressure, for results of 300..1100 hPa
+static void _testReduction(void)
+{
+	double ref, e, err = 0;
+
+	for (int32_t h = -50000; h <= 300000; h += 997) {
+		_param_centimeters = h;
+		updateReduction();
+		for (int32_t p = 30000; p <= 110000; p += 13) {
+			ref = p / pow(1 - h / 4433000.0, 5.255);
+			if (ref < 30000 || ref > 110000)
+				continue;
+			e = fabs(reducePressure(p) - ref);
+			if (e > err)
+				err = e;
+		}
+	}
+	printf("reduced pressure %.2f Pa\n", err);
+	CHECK(err <= 2);
+}
+
+int main(void)
+{
+	_testLog();
+	_testAltitude();
+	_testLowDatum();
+	_testReduction();
+
+	printf("bmp085test: %s\n", _failed ? "FAILED" : "ok");
+
+	return _failed != 0;
+}
@@ -0,0 +1,15 @@
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+/*
+ * Host stand-in for <avr/interrupt.h>. Nothing interrupts a host
+ * test by itself; a test which models a peripheral calls the
+ * handler, a plain function here.
+ */
+#define cli()		(SREG &= ~_BV(SREG_I))
+#define sei()		(SREG |= _BV(SREG_I))
+#define ISR(vector)	void vector(void)
+
+#endif /* _AVR_INTERRUPT_H_ */
@@ -0,0 +1,64 @@
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+#include <inttypes.h>
+
+/*
+ * Host stand-in for <avr/io.h>, only what the firmware sources
+ * built in tools/ touch. SREG and the other registers are plain
+ * variables of the test; the ones a test does not use need not
+ * be defined.
+ */
+#define _BV(bit)	(1 << (bit))
+#define SREG		_hostSREG
+#define SREG_I		7
+
+extern volatile uint8_t _hostSREG;
+
+// TWI
+#define TWCR		_hostTWCR
+#define TWDR		_hostTWDR
+#define TWSR		_hostTWSR
+#define TWBR		_hostTWBR
+#define TWINT		7
+#define TWEA		6
+#define TWSTA		5
+#define TWSTO		4
+#define TWWC		3
+#define TWEN		2
+#define TWIE		0
+#define TWPS1		1
+#define TWPS0		0
+
+extern volatile uint8_t _hostTWCR, _hostTWDR, _hostTWSR, _hostTWBR;
+
+// Port D, the TWI pins
+#define PORTD		_hostPORTD
+#define DDRD		_hostDDRD
+#define PIND		_hostPIND
+#define PD0			0
+#define PD1			1
+
+extern volatile uint8_t _hostPORTD, _hostDDRD, _hostPIND;
+
+// USART1
+#define UDR1		_hostUDR1
+#define UBRR1H		_hostUBRR1H
+#define UBRR1L		_hostUBRR1L
+#define UCSR1B		_hostUCSR1B
+#define UCSR1C		_hostUCSR1C
+#define RXCIE1		7
+#define RXEN1		4
+#define TXEN1		3
+#define UCSZ12		2
+#define UMSEL11		7
+#define UMSEL10		6
+#define UPM11		5
+#define UPM10		4
+#define USBS1		3
+#define UCSZ11		2
+#define UCSZ10		1
+
+extern volatile uint8_t _hostUDR1, _hostUBRR1H, _hostUBRR1L, _hostUCSR1B, _hostUCSR1C;
+
+#endif /* _AVR_IO_H_ */
@@ -0,0 +1,12 @@
+#ifndef _AVR_PGMSPACE_H_
+#define _AVR_PGMSPACE_H_
+
+#include <inttypes.h>
+
+// Host stand-in for <avr/pgmspace.h>, flash is ordinary memory here
+#define PROGMEM
+#define pgm_read_byte(p)	(*(const uint8_t *)(p))
+#define pgm_read_word(p)	(*(const uint16_t *)(p))
+#define pgm_read_dword(p)	(*(const uint32_t *)(p))
+
+#endif /* _AVR_PGMSPACE_H_ */
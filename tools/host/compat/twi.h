@@ -0,0 +1,7 @@
+#ifndef _COMPAT_TWI_H_
+#define _COMPAT_TWI_H_
+
+// Host stand-in for <compat/twi.h>, nothing of it is used
+#include <util/twi.h>
+
+#endif /* _COMPAT_TWI_H_ */
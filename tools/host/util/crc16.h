@@ -0,0 +1,19 @@
+#ifndef _UTIL_CRC16_H_
+#define _UTIL_CRC16_H_
+
+#include <inttypes.h>
+
+/*
+ * Host stand-in for <util/crc16.h> of avr-libc, to build the firmware
+ * sources in tools/. This is the C equivalent given in its manual.
+ */
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^
+			((uint16_t)data << 3));
+}
+
+#endif /* _UTIL_CRC16_H_ */
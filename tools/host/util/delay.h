@@ -0,0 +1,8 @@
+#ifndef _UTIL_DELAY_H_
+#define _UTIL_DELAY_H_
+
+// Host stand-in for <util/delay.h>, the test keeps the time
+void _delay_us(double us);
+void _delay_ms(double ms);
+
+#endif /* _UTIL_DELAY_H_ */
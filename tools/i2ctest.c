@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The transaction engine of i2c.c on a model of the TWI unit and of
+ * the slaves, in virtual time. The engine is compiled in whole. The
+ * model carries out what the engine writes to TWCR, one bus event at
+ * a time at the SCL rate set in TWBR/TWSR, and calls TWI_vect when
+ * TWINT is up, TWIE set and interrupts are on. Interrupts are taken
+ * whenever the engine looks at SREG or the time (see _sreg()), which
+ * is where they would hit on the chip.
+ *
+ * Only the interrupt driven path is covered: I2CWait() with interrupts
+ * off polls TWINT, which the model does not show in TWCR.
+ */
+#define F_CPU		16000000UL
+#include <avr/io.h>
+#undef SREG
+#define SREG		(*_sreg())
+static volatile uint8_t *_sreg(void);
+#include "i2c.c"
+
+#define CHECK(c)	_check((c), #c, __LINE__)
+
+// Slaves on the bus, 8-bit addresses
+#define DS3231		0xD0
+#define BMP085		0xEE
+#define LCD			0x40
+#define ABSENT		0xA0
+
+/*
+ * CPU cycles of one TWI_vect, entry and exit included. An estimate
+ * from the ISR code, it is not measured here.
+ */
+#define ISR_CYCLES	100
+
+volatile uint8_t _hostSREG;
+volatile uint8_t _hostTWCR, _hostTWDR, _hostTWSR, _hostTWBR;
+// SCL and SDA high, nobody holds the bus
+volatile uint8_t _hostPORTD, _hostDDRD, _hostPIND = _BV(PD0) | _BV(PD1);
+
+static unsigned long long _ns;
+static int _failed;
+
+// The TWI unit
+static struct {
+	uint8_t flag;				// TWINT raised by the hardware
+	uint8_t busy;				// carrying out an operation
+	uint8_t stop;				// the operation is a STOP
+	unsigned long long doneNs;
+	uint8_t status;				// TWSR status when it is done
+	uint8_t owner;				// START sent, no STOP yet
+	uint8_t sla;				// address byte of this START, 0 until sent
+	uint8_t next;				// next byte a slave sends
+} _twi;
+
+// What went over the wire, reset by each measurement
+static struct {
+	unsigned starts;			// START and repeated START
+	unsigned stops;
+	unsigned bytes;				// address bytes included
+	unsigned irqs;				// TWI_vect calls
+	unsigned long long busNs;	// SCL running
+} _wire;
+
+static int _inIrq;
+
+static void _check(int ok, const char *what, int line)
+{
+	if (!ok) {
+		printf("i2ctest.c:%d: FAIL %s\n", line, what);
+		_failed++;
+	}
+}
+
+static int _acks(uint8_t sla)
+{
+	sla &= ~I2C_READ;
+
+	return sla == DS3231 || sla == BMP085 || sla == LCD;
+}
+
+// One SCL period at the rate in TWBR/TWSR
+static unsigned long long _bitNs(void)
+{
+	return (16 + 2ULL * _hostTWBR * (1 << (2 * (_hostTWSR & 0x03)))) *
+		   1000000000ULL / F_CPU;
+}
+
+// Take the operation the engine wrote to TWCR
+static void _twiCommand(void)
+{
+	uint8_t c = _hostTWCR;
+	unsigned long long t = _bitNs();
+
+	_hostTWCR &= ~_BV(TWINT);
+	_twi.flag = 0;
+	_twi.busy = 1;
+	_twi.stop = 0;
+
+	if ((c & _BV(TWSTO)) && !(c & _BV(TWSTA))) {
+		_twi.stop = 1;
+		_wire.stops++;
+	} else if (c & _BV(TWSTA)) {
+		_twi.status = _twi.owner ? TW_REP_START : TW_START;
+		_twi.owner = 1;
+		_twi.sla = 0;
+		_wire.starts++;
+	} else if (!_twi.sla) {
+		_twi.sla = _hostTWDR;
+		if (_twi.sla & I2C_READ)
+			_twi.status = _acks(_twi.sla) ? TW_MR_SLA_ACK : TW_MR_SLA_NACK;
+		else
+			_twi.status = _acks(_twi.sla) ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+		_wire.bytes++;
+		t *= 9;
+	} else if (_twi.sla & I2C_READ) {
+		_hostTWDR = _twi.next++;
+		_twi.status = (c & _BV(TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+		_wire.bytes++;
+		t *= 9;
+	} else {
+		_twi.status = TW_MT_DATA_ACK;
+		_wire.bytes++;
+		t *= 9;
+	}
+	_twi.doneNs = _ns + t;
+	_wire.busNs += t;
+}
+
+// Move the hardware on to the current time
+static void _twiRun(void)
+{
+	uint8_t go = _BV(TWINT) | _BV(TWEN);
+
+	if (!_twi.busy && (_hostTWCR & go) == go)
+		_twiCommand();
+	if (!_twi.busy || _ns < _twi.doneNs)
+		return;
+
+	_twi.busy = 0;
+	if (_twi.stop) {
+		// A STOP raises no TWINT, TWSTO just drops
+		_hostTWCR &= ~_BV(TWSTO);
+		_twi.owner = 0;
+	} else {
+		_hostTWSR = (_hostTWSR & 0x03) | _twi.status;
+		_twi.flag = 1;
+	}
+}
+
+static void _irq(void)
+{
+	if (_inIrq || !(_hostSREG & _BV(SREG_I)))
+		return;
+	if (!_twi.flag || !(_hostTWCR & _BV(TWIE)))
+		return;
+
+	_inIrq = 1;
+	_hostSREG &= ~_BV(SREG_I);
+	_wire.irqs++;
+	TWI_vect();
+	_hostSREG |= _BV(SREG_I);
+	_inIrq = 0;
+}
+
+static volatile uint8_t *_sreg(void)
+{
+	_twiRun();
+	_irq();
+
+	return &_hostSREG;
+}
+
+// The timer, every look at it is a microsecond of CPU time
+unsigned long micros(void)
+{
+	_ns += 1000;
+	_twiRun();
+	_irq();
+
+	return _ns / 1000;
+}
+
+unsigned long millis(void)
+{
+	return _ns / 1000000;
+}
+
+void _delay_us(double us)
+{
+	_ns += us * 1000;
+	_twiRun();
+	_irq();
+}
+
+void _delay_ms(double ms)
+{
+	_delay_us(ms * 1000);
+}
+
+static void _measure(void)
+{
+	memset(&_wire, 0, sizeof(_wire));
+}
+
+// Let a STOP the last call left behind go out
+static void _settle(void)
+{
+	for (int i = 0; i < 100; i++)
+		micros();
+}
+
+static unsigned _us(unsigned long long ns)
+{
+	return (ns + 500) / 1000;
+}
+
+/*
+ * A 16-byte write to the LCD, submitted and left to the interrupt.
+ * The engine needs one TWI_vect per bus event and nothing else.
+ */
+static void _testAsync(void)
+{
+	static uint8_t buf[16];
+	struct I2CXfer x = { .addr = LCD, .wbuf = buf, .wlen = sizeof(buf) };
+	unsigned long long start, busy;
+	double isrNs;
+	unsigned loops = 0;
+
+	_settle();
+	_measure();
+	start = _ns;
+	I2CSubmit(&x);
+	// The loop is free while the bytes go out
+	while (x.status == EI2CBUSY) {
+		_delay_us(1);
+		loops++;
+	}
+	busy = _ns - start;
+	_settle();
+
+	printf("async 16-byte write: %u bytes, %u irqs in %u us on the bus,"
+		   " %u us of loop free\n", _wire.bytes, _wire.irqs,
+		   _us(_wire.busNs), loops);
+	CHECK(x.status == ESUCCESS);
+	CHECK(_wire.starts == 1 && _wire.stops == 1);
+	CHECK(_wire.bytes == 1 + sizeof(buf));
+	// START, address and data bytes; the STOP raises none
+	CHECK(_wire.irqs == 1 + _wire.bytes);
+	// START, 17 bytes of 9 bits and STOP at 100 kHz
+	CHECK(_us(_wire.busNs) == (2 + 9 * 17) * 10);
+	CHECK(busy < (_wire.busNs + 50000));
+	// The CPU share of the engine at ISR_CYCLES per interrupt
+	isrNs = _wire.irqs * ISR_CYCLES * 1e9 / F_CPU;
+	printf("  ISR time at %u cycles each: %.1f%% of the bus time\n",
+		   ISR_CYCLES, 100 * isrNs / _wire.busNs);
+	CHECK(isrNs < _wire.busNs / 10);
+}
+
+/*
+ * DS3231_get, a register pointer write and a 7-byte read: a burst with
+ * a repeated START against the byte-level calls of the old driver.
+ */
+static void _testBurst(void)
+{
+	const uint8_t reg = 0;
+	uint8_t buf[7];
+	unsigned long long start, burstNs, byteNs;
+	unsigned calls = 0;
+
+	_settle();
+	_measure();
+	start = _ns;
+	CHECK(I2CWriteThenRead(DS3231, &reg, 1, buf, sizeof(buf)) == ESUCCESS);
+	burstNs = _ns - start;
+	_settle();
+	printf("DS3231_get burst: %u bytes, %u START, %u STOP, 1 call, %u us\n",
+		   _wire.bytes, _wire.starts, _wire.stops, _us(burstNs));
+	CHECK(_wire.bytes == 10);
+	CHECK(_wire.starts == 2 && _wire.stops == 1);
+	// START, repeated START, 10 bytes and STOP at 100 kHz
+	CHECK(_us(_wire.busNs) == (3 + 9 * 10) * 10);
+
+	_measure();
+	start = _ns;
+	CHECK(I2CStart(DS3231) == ESUCCESS);
+	CHECK(I2CWriteByte(reg) == ESUCCESS);
+	CHECK(I2CStop() == ESUCCESS);
+	CHECK(I2CStart(DS3231 | I2C_READ) == ESUCCESS);
+	calls += 4;
+	for (uint8_t i = 0; i < sizeof(buf); i++, calls++)
+		CHECK(I2CReadByte(&buf[i], i + 1 < sizeof(buf) ? I2C_ACK : I2C_NOACK) == ESUCCESS);
+	CHECK(I2CStop() == ESUCCESS);
+	calls++;
+	byteNs = _ns - start;
+	_settle();
+	printf("DS3231_get byte-level: %u bytes, %u START, %u STOP, %u calls, %u us\n",
+		   _wire.bytes, _wire.starts, _wire.stops, calls, _us(byteNs));
+	CHECK(_wire.bytes == 10);
+	CHECK(_wire.starts == 2 && _wire.stops == 2);
+	CHECK(calls == 12);
+	CHECK(burstNs < byteNs);
+
+	// BMP085 readmem(), 2 bytes
+	_measure();
+	start = _ns;
+	CHECK(I2CWriteThenRead(BMP085, &reg, 1, buf, 2) == ESUCCESS);
+	printf("BMP085 readmem(2) burst: %u bytes, %u us\n", _wire.bytes,
+		   _us(_ns - start));
+	_settle();
+	CHECK(_wire.bytes == 5);
+	CHECK(_wire.starts == 2 && _wire.stops == 1);
+}
+
+// A missing slave fails the transaction after its address byte
+static void _testNak(void)
+{
+	uint8_t b = 0;
+
+	_settle();
+	_measure();
+	CHECK(I2CWriteBuf(ABSENT, &b, 1) == EI2CWRITE);
+	_settle();
+	CHECK(_wire.bytes == 1);
+	CHECK(_wire.stops == 1);
+	// The bus is free for the next one
+	CHECK(I2CWriteBuf(LCD, &b, 1) == ESUCCESS);
+}
+
+int main(void)
+{
+	I2CInit();
+	sei();
+
+	_testAsync();
+	_testBurst();
+	_testNak();
+
+	printf("i2ctest: %s\n", _failed ? "FAILED" : "ok");
+
+	return _failed != 0;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Bytes the LCD driver puts on the bus, the frameBytes() of lcd.c
+ * against what the transactions carried. The driver is compiled in
+ * whole for a two-line panel; the bus takes every write at once and
+ * the busy flag reads as not wired.
+ */
+#define TWO_LINE_LCD
+#include "lcd.c"
+
+#define CHECK(c)	_check((c), #c, __LINE__)
+
+// One transaction at the 100 kHz of the backpack: START, bytes and STOP
+#define XFER_US(n)	((2 + 9 * (1 + (n))) * 10)
+
+volatile uint8_t _hostSREG;
+static int _failed;
+static void (*_tick)(void);
+
+// What the LCD got, reset by each measurement
+static struct {
+	unsigned xfers;
+	unsigned bytes;			// address bytes excluded
+	unsigned long us;		// on the bus
+} _wire;
+
+static void _check(int ok, const char *what, int line)
+{
+	if (!ok) {
+		printf("lcdtest.c:%d: FAIL %s\n", line, what);
+		_failed++;
+	}
+}
+
+static void _count(uint8_t len)
+{
+	_wire.xfers++;
+	_wire.bytes += len;
+	_wire.us += XFER_US(len);
+}
+
+uint8_t I2CSetSpeed(uint8_t addr, uint32_t scl) { return ESUCCESS; }
+uint8_t I2CSetPriority(uint8_t addr, uint8_t prio) { return ESUCCESS; }
+uint8_t I2CPresent(uint8_t addr) { return 1; }
+void I2CPoll(void) { }
+uint8_t I2CWait(struct I2CXfer *xfer) { return xfer->status; }
+unsigned long micros(void) { return 0; }
+unsigned long millis(void) { return 0; }
+void _delay_us(double us) { }
+void _delay_ms(double ms) { }
+
+uint8_t tmr_add_tick(void (*tick)(void))
+{
+	_tick = tick;
+
+	return ESUCCESS;
+}
+
+uint8_t I2CWriteBuf(uint8_t addr, const uint8_t *buf, uint8_t len)
+{
+	_count(len);
+
+	return ESUCCESS;
+}
+
+// RW is tied low: the PCF8574 reads back its released pins
+uint8_t I2CWriteThenRead(uint8_t addr, const uint8_t *wbuf, uint8_t wlen,
+						 uint8_t *rbuf, uint8_t rlen)
+{
+	_count(wlen);
+	memset(rbuf, 0xFF, rlen);
+
+	return ESUCCESS;
+}
+
+// The slice is done as soon as it is submitted
+uint8_t I2CSubmit(struct I2CXfer *xfer)
+{
+	_count(xfer->wlen);
+	xfer->status = ESUCCESS;
+	xfer->done(xfer);
+
+	return ESUCCESS;
+}
+
+static void _measure(void)
+{
+	memset(&_wire, 0, sizeof(_wire));
+}
+
+// Loop and tick until the frame is on the screen
+static uint16_t _redraw(struct LCD *screen)
+{
+	struct LCDStats stats;
+
+	screen->update();
+	for (int i = 0; i < 100; i++) {
+		screen->refresh();
+		_tick();
+	}
+	screen->getStats(&stats);
+
+	return stats.frameBytes;
+}
+
+int main(void)
+{
+	struct LCD *screen = lcdInit();
+	char (*frame)[LCD_COLS] = (char (*)[LCD_COLS])screen->frame();
+	char line[LCD_COLS];
+	uint16_t bytes;
+
+	CHECK(_noBusyFlag);
+
+	/*
+	 * All 32 chars change: 4 runs of LCD_SLICE_CHARS, each an address
+	 * command (4 bytes) and 8 chars (32), plus the RS switches, two
+	 * per run but the first which follows a command.
+	 */
+	memset(frame, 'A', NUM_LINES * LCD_COLS);
+	_measure();
+	bytes = _redraw(screen);
+	printf("full redraw: %u bytes in %u transactions, %lu us on the bus"
+		   " (%u with an address command per char)\n", bytes, _wire.xfers,
+		   _wire.us, NUM_LINES * LCD_COLS * (1 + 4 + 1 + 4));
+	CHECK(bytes == 4 * (4 + 8 * 4 + 2) - 1);
+	CHECK(_wire.bytes == bytes);
+	CHECK(_wire.xfers == 4);
+
+	// The minutes digit of the clock: a command and one char
+	frame[0][4] = 'B';
+	_measure();
+	bytes = _redraw(screen);
+	printf("one char: %u bytes in %u transactions, %lu us on the bus\n",
+		   bytes, _wire.xfers, _wire.us);
+	CHECK(bytes == 1 + 4 + 1 + 4);
+	CHECK(_wire.xfers == 1);
+
+	// Nothing changed, nothing sent
+	_measure();
+	bytes = _redraw(screen);
+	CHECK(bytes == 0);
+	CHECK(_wire.xfers == 0);
+
+	// A whole line through printString(), one address command
+	memset(line, 'C', sizeof(line));
+	_measure();
+	CHECK(screen->printString(line, 1, 0, sizeof(line)) == 0);
+	printf("printString(16): %u bytes in %u transactions, %lu us on the bus\n",
+		   _wire.bytes, _wire.xfers, _wire.us);
+	CHECK(_wire.bytes == 1 + 4 + 1 + LCD_COLS * 4);
+	CHECK(_wire.xfers == 1);
+	// and the frame has it, the refresh leaves it alone
+	CHECK(memcmp(frame[1], line, sizeof(line)) == 0);
+	_measure();
+	CHECK(_redraw(screen) == 0);
+
+	printf("lcdtest: %s\n", _failed ? "FAILED" : "ok");
+
+	return _failed != 0;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * Noise of the background sampler of bmp085.c against its output
+ * rate. The driver is compiled in whole and run from a 1.024 ms tick
+ * in virtual time, as on TIMER0_OVF. The bus completes every transfer
+ * at once and the chip answers with the datasheet calibration, a fixed
+ * temperature and a pressure with seeded Gaussian noise.
+ */
+#include "bmp085.c"
+
+#define CHECK(c)	_check((c), #c, __LINE__)
+
+// TIMER0_OVF period, us
+#define TICK_US		1024
+// Noise of a single conversion, Pa RMS, about the standard mode figure
+#define NOISE_PA	5.0
+// Raw readings of the datasheet example, 15.0 C and ~700 hPa at oss 0
+#define UT			27898
+#define UP			23843
+// Outputs taken for each rate
+#define OUTPUTS		400
+
+volatile uint8_t _hostSREG;
+static int _failed;
+static unsigned long _now;			// us
+static uint8_t _cmd;				// last command written to CONTROL
+static double _upSigma;				// noise in UP counts, for NOISE_PA
+static uint32_t _seed = 12345;
+
+uint8_t I2CSetSpeed(uint8_t addr, uint32_t scl) { return ESUCCESS; }
+uint8_t I2CSetPriority(uint8_t addr, uint8_t prio) { return ESUCCESS; }
+uint8_t I2CPresent(uint8_t addr) { return 1; }
+void I2CPoll(void) { }
+uint8_t I2CWriteBuf(uint8_t addr, const uint8_t *buf, uint8_t len) { return EI2CNODEV; }
+uint8_t I2CWriteThenRead(uint8_t addr, const uint8_t *wbuf, uint8_t wlen,
+						 uint8_t *rbuf, uint8_t rlen) { return EI2CNODEV; }
+uint8_t tmr_add_tick(void (*tick)(void)) { return 1; }
+unsigned long micros(void) { return _now; }
+unsigned long millis(void) { return _now / 1000; }
+
+static void _check(int ok, const char *what, int line)
+{
+	if (!ok) {
+		printf("sampletest.c:%d: FAIL %s\n", line, what);
+		_failed++;
+	}
+}
+
+// xorshift32 and Box-Muller, the same numbers on every host
+static double _uniform(void)
+{
+	_seed ^= _seed << 13;
+	_seed ^= _seed >> 17;
+	_seed ^= _seed << 5;
+
+	return (_seed + 1.0) / 4294967297.0;
+}
+
+static double _gauss(void)
+{
+	return sqrt(-2 * log(_uniform())) * cos(2 * 3.14159265358979 * _uniform());
+}
+
+// The chip: a command starts a conversion, a read returns its result
+uint8_t I2CSubmit(struct I2CXfer *xfer)
+{
+	long up;
+
+	if (xfer->wlen == 2 && xfer->wbuf[0] == CONTROL) {
+		_cmd = xfer->wbuf[1];
+	} else if (_cmd == READ_TEMPERATURE) {
+		xfer->rbuf[0] = UT >> 8;
+		xfer->rbuf[1] = UT & 0xFF;
+	} else {
+		up = lround(((UP << _oss) + _upSigma * _gauss()) * (1 << (8 - _oss)));
+		xfer->rbuf[0] = up >> 16;
+		xfer->rbuf[1] = up >> 8;
+		xfer->rbuf[2] = up;
+	}
+	xfer->status = ESUCCESS;
+	if (xfer->done)
+		xfer->done(xfer);
+
+	return ESUCCESS;
+}
+
+static void _calibrate(void)
+{
+	ac1 = 408;
+	ac2 = -72;
+	ac3 = -14383;
+	ac4 = 32741;
+	ac5 = 32757;
+	ac6 = 23153;
+	b1 = 6190;
+	b2 = 4;
+	mb = -32768;
+	mc = -8711;
+	md = 2868;
+	_calValid = 1;
+}
+
+/*
+ * Run the sampler with n samples an output until OUTPUTS are taken.
+ * Returns the RMS error of the outputs in Pa, the rate in *perSec.
+ */
+static double _rms(uint8_t n, double *perSec)
+{
+	int32_t pa, ref;
+	long t;
+	unsigned long start;
+	double sum = 0;
+	unsigned got = 0;
+
+	ref = reducePressure(compensatePressure(UP << _oss,
+						 compensateTemperature(UT)));
+	CHECK(startSampling(n) == ESUCCESS);
+	start = _now;
+	while (got < OUTPUTS) {
+		_now += TICK_US;
+		_sampleTick();
+		if (readSampled(&t, &pa) == ESUCCESS) {
+			sum += (double)(pa - ref) * (pa - ref);
+			got++;
+		}
+	}
+	stopSampling();
+	*perSec = got * 1e6 / (_now - start);
+
+	return sqrt(sum / got);
+}
+
+int main(void)
+{
+	static const uint8_t rates[] = { 1, 4, 16, 64, 100 };
+	double rms, perSec, last = 1e9;
+	long pa;
+
+	_calibrate();
+	_dev_address = BMP085_ADDR;
+	_oss = MODE_STANDARD;
+	// Pa per UP count at the test point
+	pa = compensatePressure((UP << _oss) + 1000, compensateTemperature(UT)) -
+		 compensatePressure(UP << _oss, compensateTemperature(UT));
+	_upSigma = NOISE_PA * 1000 / pa;
+
+	printf("   n  outputs/s     RMS\n");
+	for (uint8_t i = 0; i < sizeof(rates); i++) {
+		rms = _rms(rates[i], &perSec);
+		printf("%4u %10.2f %5.2f Pa\n", rates[i], perSec, rms);
+		/*
+		 * The average of n samples: NOISE_PA / sqrt(n), 10% for the
+		 * finite run, and the rounding to whole UP counts on top.
+		 */
+		CHECK(rms <= 1.1 * NOISE_PA / sqrt(rates[i]) + 0.3);
+		CHECK(rms < last);
+		last = rms;
+		/*
+		 * A standard mode conversion (7.5 ms) is polled on the tick,
+		 * 9 ticks a sample, and a temperature takes a slot a second
+		 */
+		CHECK(perSec * rates[i] > 100 && perSec * rates[i] < 110);
+	}
+
+	printf("sampletest: %s\n", _failed ? "FAILED" : "ok");
+
+	return _failed != 0;
+}
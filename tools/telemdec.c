@@ -0,0 +1,123 @@
+#include <string.h>
+#include "telemdec.h"
+
+static void _byte(struct TelemDecoder *d, uint8_t c);
+
+/*
+ * CRC-16/MCRF4XX bit by bit, start with 0xFFFF. It does not share
+ * code with the _crc_ccitt_update() of the firmware, so telemtest
+ * checks one against the other.
+ */
+uint16_t telemdec_crc(uint16_t crc, const uint8_t *p, size_t n)
+{
+	while (n--) {
+		crc ^= *p++;
+		for (uint8_t i = 0; i < 8; i++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+	}
+
+	return crc;
+}
+
+static uint32_t _le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		   (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t _le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+void telemdec_init(struct TelemDecoder *d, TelemHandler handler, void *ctx)
+{
+	memset(d, 0, sizeof(*d));
+	d->handler = handler;
+	d->ctx = ctx;
+}
+
+/*
+ * Drop the sync byte of a bad frame and scan the rest again, a good
+ * frame may start in it when the host lost the tail of the bad one.
+ */
+static void _resync(struct TelemDecoder *d)
+{
+	uint8_t rest[sizeof(d->buf)];
+	size_t n = d->n - 1;
+
+	d->errors++;
+	d->skipped++;
+	memcpy(rest, &d->buf[1], n);
+	d->n = 0;
+	for (size_t i = 0; i < n; i++)
+		_byte(d, rest[i]);
+}
+
+static void _frame(struct TelemDecoder *d)
+{
+	struct TelemFrame f;
+	size_t n = TELEM_HEADER + d->buf[2];
+
+	if (telemdec_crc(0xFFFF, &d->buf[1], n - 1) != _le16(&d->buf[n])) {
+		_resync(d);
+		return;
+	}
+
+	f.type = d->buf[1];
+	f.len = d->buf[2];
+	f.seq = d->buf[3];
+	f.millis = _le32(&d->buf[4]);
+	memcpy(f.payload, &d->buf[TELEM_HEADER], f.len);
+	d->n = 0;
+
+	// The firmware restarting from 0 shows up as a loss too
+	if (d->synced)
+		d->lost += (uint8_t)(f.seq - d->nextSeq);
+	d->synced = 1;
+	d->nextSeq = f.seq + 1;
+	d->frames++;
+
+	if (d->handler)
+		d->handler(&f, d->ctx);
+}
+
+static void _byte(struct TelemDecoder *d, uint8_t c)
+{
+	if (d->n == 0 && c != TELEM_SYNC) {
+		d->skipped++;
+		return;
+	}
+
+	d->buf[d->n++] = c;
+	if (d->n == 3 && c > TELEM_MAX_PAYLOAD)
+		_resync(d);
+	else if (d->n > 3 && d->n == (size_t)TELEM_HEADER + d->buf[2] + TELEM_CRC)
+		_frame(d);
+}
+
+void telemdec_feed(struct TelemDecoder *d, const uint8_t *p, size_t n)
+{
+	while (n--)
+		_byte(d, *p++);
+}
+
+// Returns 0 if the frame is a TELEM_SAMPLE, -1 otherwise
+int telemdec_sample(const struct TelemFrame *frame, struct TelemValues *v)
+{
+	const uint8_t *p = frame->payload;
+
+	if (frame->type != TELEM_SAMPLE || frame->len != 14)
+		return -1;
+
+	v->hour = p[0];
+	v->min = p[1];
+	v->sec = p[2];
+	v->flags = p[3];
+	v->pressure = (int32_t)_le32(&p[4]);
+	v->inTemp10 = (int16_t)_le16(&p[8]);
+	v->outTemp10 = (int16_t)_le16(&p[10]);
+	v->humidity10 = _le16(&p[12]);
+
+	return 0;
+}
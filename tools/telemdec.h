@@ -0,0 +1,52 @@
+#ifndef _TELEMDEC_H_
+#define _TELEMDEC_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "telem.h"
+
+/*
+ * Reference decoder of the binary telemetry, see telem.h. It runs
+ * on the host: bytes go in as they come from the serial port, every
+ * frame with a good CRC is handed to the handler.
+ */
+struct TelemFrame {
+	uint8_t type;				// TELEM_*
+	uint8_t len;				// payload length
+	uint8_t seq;
+	uint32_t millis;
+	uint8_t payload[TELEM_MAX_PAYLOAD];
+};
+
+// TELEM_SAMPLE payload, taken apart byte by byte
+struct TelemValues {
+	uint8_t hour, min, sec;
+	uint8_t flags;				// TELEM_FLAG_*
+	int32_t pressure;
+	int16_t inTemp10;
+	int16_t outTemp10;
+	uint16_t humidity10;
+};
+
+typedef void (*TelemHandler)(const struct TelemFrame *frame, void *ctx);
+
+struct TelemDecoder {
+	uint8_t buf[TELEM_HEADER + TELEM_MAX_PAYLOAD + TELEM_CRC];
+	size_t n;					// bytes of the frame so far
+	TelemHandler handler;
+	void *ctx;
+	int synced;					// nextSeq is known
+	uint8_t nextSeq;
+	// Statistics
+	unsigned long frames;		// good frames
+	unsigned long errors;		// frames dropped for a bad length or CRC
+	unsigned long lost;			// frames missing from the sequence numbers
+	unsigned long skipped;		// bytes thrown away looking for a frame
+};
+
+uint16_t telemdec_crc(uint16_t crc, const uint8_t *p, size_t n);
+void telemdec_init(struct TelemDecoder *d, TelemHandler handler, void *ctx);
+void telemdec_feed(struct TelemDecoder *d, const uint8_t *p, size_t n);
+int telemdec_sample(const struct TelemFrame *frame, struct TelemValues *v);
+
+#endif /* _TELEMDEC_H_ */
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "telemdec.h"
+
+/*
+ * Print the telemetry frames read from stdin, one per line, and the
+ * decoder statistics at the end. With the board on /dev/ttyACM0:
+ *
+ *	stty -F /dev/ttyACM0 raw -echo
+ *	printf b > /dev/ttyACM0
+ *	tools/telemdump < /dev/ttyACM0
+ */
+
+static void _tenths(char *buf, int v)
+{
+	sprintf(buf, "%s%d.%d", v < 0 ? "-" : "", abs(v) / 10, abs(v) % 10);
+}
+
+static void _print(const struct TelemFrame *f, void *ctx)
+{
+	struct TelemValues v;
+	char in[8], out[8];
+
+	(void)ctx;
+	// Replies to commands, as the text mode shows them
+	if (f->type == TELEM_TEXT) {
+		fwrite(f->payload, 1, f->len, stdout);
+		fflush(stdout);
+		return;
+	}
+
+	printf("%10lu #%3u ", (unsigned long)f->millis, f->seq);
+	switch (f->type) {
+	case TELEM_SAMPLE:
+		if (telemdec_sample(f, &v) != 0) {
+			printf("SAMPLE, bad length %u\n", f->len);
+			break;
+		}
+		_tenths(in, v.inTemp10);
+		_tenths(out, v.outTemp10);
+		printf("%02u:%02u:%02u%s%s P %ld H %u.%u in %s out %s\n",
+			   v.hour, v.min, v.sec,
+			   v.flags & TELEM_FLAG_TIMEFIX ? " TIME" : "",
+			   v.flags & TELEM_FLAG_DATEFIX ? " DATE" : "",
+			   (long)v.pressure, v.humidity10 / 10, v.humidity10 % 10,
+			   in, out);
+		break;
+	case TELEM_NMEA:
+		printf("%.*s\n", f->len, (const char *)f->payload);
+		break;
+	default:
+		printf("type 0x%02X, %u bytes\n", f->type, f->len);
+		break;
+	}
+	fflush(stdout);
+}
+
+int main(void)
+{
+	struct TelemDecoder d;
+	uint8_t buf[256];
+	size_t n;
+
+	telemdec_init(&d, _print, NULL);
+	while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0)
+		telemdec_feed(&d, buf, n);
+
+	fprintf(stderr, "%lu frames, %lu lost, %lu bad, %lu bytes skipped\n",
+			d.frames, d.lost, d.errors, d.skipped);
+
+	return 0;
+}
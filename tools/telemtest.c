@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+#include <util/crc16.h>
+#include "telemdec.h"
+
+/*
+ * Round trip of the telemetry frames: telem.c of the firmware builds
+ * them, the reference decoder takes them apart. The first frame is
+ * compared byte by byte with one worked out by hand, which pins the
+ * wire format of telem.h.
+ */
+
+#define CHECK(c)	_check((c), #c, __LINE__)
+
+static const char _nmea[] =
+	"$GPRMC,123456.00,A,5546.123,N,03736.456,E,0.0,0.0,010120,,,A*6C";
+#define NMEA_LEN		(sizeof(_nmea) - 1)
+// Frame sizes on the wire
+#define SAMPLE_FRAME	(TELEM_HEADER + 14 + TELEM_CRC)
+#define NMEA_FRAME		(TELEM_HEADER + NMEA_LEN + TELEM_CRC)
+#define PAIR			(SAMPLE_FRAME + NMEA_FRAME)
+
+static unsigned long _now;
+static int _failed;
+
+static struct TelemFrame _got[64];
+static unsigned _ngot;
+
+// Stands in for the timer of the firmware
+unsigned long millis(void)
+{
+	return _now;
+}
+
+static void _check(int ok, const char *what, int line)
+{
+	if (!ok) {
+		printf("telemtest.c:%d: FAIL %s\n", line, what);
+		_failed++;
+	}
+}
+
+static void _collect(const struct TelemFrame *f, void *ctx)
+{
+	(void)ctx;
+	if (_ngot < sizeof(_got) / sizeof(_got[0]))
+		_got[_ngot++] = *f;
+}
+
+static void _testCrc(void)
+{
+	uint16_t a, b;
+
+	// The check value of CRC-16/MCRF4XX
+	CHECK(telemdec_crc(0xFFFF, (const uint8_t *)"123456789", 9) == 0x6F91);
+	// and the avr-libc update step agrees with it everywhere
+	for (uint32_t i = 0; i < 0x10000; i += 7) {
+		uint8_t c = i * 13;
+
+		a = _crc_ccitt_update(i, c);
+		b = telemdec_crc(i, &c, 1);
+		if (a != b) {
+			CHECK(a == b);
+			break;
+		}
+	}
+}
+
+static void _testFormat(void)
+{
+	static const uint8_t expect[] = {
+		0xA5, 0x01, 0x0E, 0x00, 0x01, 0x02, 0x03, 0x04,
+		0x0C, 0x22, 0x38, 0x03, 0xCD, 0x8B, 0x01, 0x00,
+		0xF1, 0xFF, 0xEA, 0x00, 0x37, 0x02, 0x02, 0xDC,
+	};
+	struct TelemSample s = {
+		.hour = 12, .min = 34, .sec = 56,
+		.flags = TELEM_FLAG_TIMEFIX | TELEM_FLAG_DATEFIX,
+		.pressure = 101325, .inTemp10 = -15, .outTemp10 = 234,
+		.humidity10 = 567,
+	};
+	uint8_t buf[TELEM_HEADER + TELEM_MAX_PAYLOAD + TELEM_CRC];
+	uint8_t big[TELEM_MAX_PAYLOAD + 1];
+
+	CHECK(sizeof(s) == 14);
+	_now = 0x04030201;
+	CHECK(telem_frame(buf, TELEM_SAMPLE, &s, sizeof(s)) == sizeof(expect));
+	CHECK(memcmp(buf, expect, sizeof(expect)) == 0);
+	// Too long a payload is refused and takes no sequence number
+	CHECK(telem_frame(buf, TELEM_NMEA, big, sizeof(big)) == 0);
+}
+
+// Frames of every kind, with 0xA5 in the payload now and then
+static size_t _encode(uint8_t *out, struct TelemSample *sent, unsigned n)
+{
+	uint8_t payload[TELEM_MAX_PAYLOAD];
+	size_t len = 0;
+
+	for (unsigned i = 0; i < n; i++) {
+		sent[i].hour = i % 24;
+		sent[i].min = (i * 7) % 60;
+		sent[i].sec = 0xA5 % 60;
+		sent[i].flags = i & 3;
+		sent[i].pressure = 0xA5A5 + (int32_t)i * 997 - 50000;
+		sent[i].inTemp10 = -400 + i * 37;
+		sent[i].outTemp10 = 850 - i * 41;
+		sent[i].humidity10 = 0xA5 + i * 9;
+		_now += 1000;
+		if (i % 4 == 3) {
+			// payloads up to the longest one allowed
+			memset(payload, 0xA5, sizeof(payload));
+			len += telem_frame(&out[len], 0x7F, payload,
+							   i * 11 % (TELEM_MAX_PAYLOAD + 1));
+		}
+		len += telem_frame(&out[len], TELEM_SAMPLE, &sent[i], sizeof(sent[i]));
+		len += telem_frame(&out[len], TELEM_NMEA, _nmea, NMEA_LEN);
+	}
+
+	return len;
+}
+
+static int _sameSample(const struct TelemFrame *f, const struct TelemSample *s)
+{
+	struct TelemValues v;
+
+	return telemdec_sample(f, &v) == 0 &&
+		   v.hour == s->hour && v.min == s->min && v.sec == s->sec &&
+		   v.flags == s->flags && v.pressure == s->pressure &&
+		   v.inTemp10 == s->inTemp10 && v.outTemp10 == s->outTemp10 &&
+		   v.humidity10 == s->humidity10;
+}
+
+static void _testRoundTrip(void)
+{
+	static uint8_t stream[8192], noisy[8400];
+	struct TelemSample sent[16];
+	struct TelemDecoder d;
+	size_t len, n = 0;
+	unsigned samples = 0;
+
+	len = _encode(stream, sent, 16);
+	// Line noise before the frames, after the first pair and at the end
+	noisy[n++] = 0xA5;
+	noisy[n++] = 0x00;
+	noisy[n++] = 0xA5;
+	memcpy(&noisy[n], stream, PAIR);
+	n += PAIR;
+	noisy[n++] = 0x55;
+	noisy[n++] = 0xA5;
+	memcpy(&noisy[n], &stream[PAIR], len - PAIR);
+	n += len - PAIR;
+	noisy[n++] = 0xA5;
+
+	_ngot = 0;
+	telemdec_init(&d, _collect, NULL);
+	// One byte at a time, as from a slow port
+	for (size_t i = 0; i < n; i++)
+		telemdec_feed(&d, &noisy[i], 1);
+
+	CHECK(d.frames == 16 * 2 + 4);
+	CHECK(d.lost == 0);
+	for (unsigned i = 0; i < _ngot; i++) {
+		if (_got[i].type != TELEM_SAMPLE)
+			continue;
+		CHECK(samples < 16 && _sameSample(&_got[i], &sent[samples]));
+		samples++;
+	}
+	CHECK(samples == 16);
+	CHECK(_ngot > 1 && _got[1].type == TELEM_NMEA && _got[1].len == NMEA_LEN &&
+		  memcmp(_got[1].payload, _nmea, NMEA_LEN) == 0);
+	CHECK(_ngot > 1 && _got[1].millis == _got[0].millis);
+}
+
+static void _testLoss(void)
+{
+	static uint8_t stream[8192];
+	struct TelemSample sent[4];
+	struct TelemDecoder d;
+	size_t len, f1, f2;
+
+	// Two sample + NMEA pairs
+	len = _encode(stream, sent, 2);
+	f1 = SAMPLE_FRAME;
+	f2 = PAIR;
+	CHECK(len == 2 * PAIR);
+
+	// A whole frame missing
+	_ngot = 0;
+	telemdec_init(&d, _collect, NULL);
+	telemdec_feed(&d, stream, f1);
+	telemdec_feed(&d, &stream[f2], len - f2);
+	CHECK(d.frames == 3 && d.lost == 1 && d.errors == 0);
+
+	// A frame cut short, its length runs into the next frame
+	_ngot = 0;
+	telemdec_init(&d, _collect, NULL);
+	telemdec_feed(&d, stream, f1 + 30);
+	telemdec_feed(&d, &stream[f2], len - f2);
+	CHECK(d.frames == 3 && d.lost == 1 && d.errors == 1);
+	CHECK(_ngot == 3 && _sameSample(&_got[1], &sent[1]));
+
+	// A flipped bit
+	_ngot = 0;
+	stream[f2 + 10] ^= 0x10;
+	telemdec_init(&d, _collect, NULL);
+	telemdec_feed(&d, stream, len);
+	CHECK(d.frames == 3 && d.lost == 1 && d.errors == 1);
+	CHECK(_ngot == 3 && _got[2].type == TELEM_NMEA);
+}
+
+int main(void)
+{
+	_testCrc();
+	_testFormat();
+	_testRoundTrip();
+	_testLoss();
+
+	printf("telemtest: %s\n", _failed ? "FAILED" : "ok");
+
+	return _failed != 0;
+}
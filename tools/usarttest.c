@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The GPS sentence ring of usart.c under the 1 Hz burst of a
+ * receiver, in virtual time. The RX interrupt is fed one char per
+ * char time, the GPS task takes the queue every 20 ms as the
+ * scheduler runs it, and once a burst it is held off by a blocking
+ * call for a while. The longest hold-off no sentence is lost with
+ * is found for each baud rate.
+ */
+#include "usart.c"
+
+#define CHECK(c)	_check((c), #c, __LINE__)
+
+// GPS task period, ms, as in the task table of main.c
+#define TASK_MS		20
+// Receiver bursts, and the time the bursts drift against the task
+#define BURST_US	1000000UL
+#define DRIFT_US	1300
+#define BURSTS		200
+/*
+ * Hold-off the ring must ride out at any baud rate. It holds a whole
+ * burst, so the task may be late by most of the second between two.
+ */
+#define HOLDOFF_MS	900
+
+volatile uint8_t _hostSREG;
+volatile uint8_t _hostUDR1, _hostUBRR1H, _hostUBRR1L, _hostUCSR1B, _hostUCSR1C;
+
+static int _failed;
+
+/*
+ * One burst of a u-blox receiver at the default rate: seven
+ * sentences, 439 chars. The second GSV is nearly the longest (82).
+ */
+static const char *const _burst[] = {
+	"$GPRMC,123519.00,A,5546.12345,N,03736.45678,E,0.012,,230394,,,A*57\r\n",
+	"$GPVTG,,T,,M,0.012,N,0.022,K,A*2A\r\n",
+	"$GPGGA,123519.00,5546.12345,N,03736.45678,E,1,08,0.94,154.2,M,14.1,M,,*5B\r\n",
+	"$GPGSA,A,3,10,07,05,02,29,04,08,13,,,,,1.72,1.03,1.38*0A\r\n",
+	"$GPGSV,3,1,11,10,63,137,17,07,61,098,15,05,59,290,20,08,54,157,30*70\r\n",
+	"$GPGSV,3,2,11,02,39,223,19,13,28,070,17,26,23,252,,04,14,186,14,29,09,301,24*7F\r\n",
+	"$GPGLL,5546.12345,N,03736.45678,E,123519.00,A,A*6E\r\n",
+};
+#define BURST_LEN	(sizeof(_burst) / sizeof(_burst[0]))
+
+static struct {
+	unsigned long got;		// sentences the task took
+	unsigned long bad;		// not one of the burst, torn
+	unsigned long skipped;	// not the one expected next
+	unsigned next;			// index in _burst expected next
+} _task;
+
+static void _check(int ok, const char *what, int line)
+{
+	if (!ok) {
+		printf("usarttest.c:%d: FAIL %s\n", line, what);
+		_failed++;
+	}
+}
+
+// Which sentence of the burst s is, the LF is stripped and the CR stays
+static int _find(const char *s)
+{
+	for (unsigned i = 0; i < BURST_LEN; i++) {
+		if (strlen(s) + 1 == strlen(_burst[i]) &&
+			strncmp(s, _burst[i], strlen(s)) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+// taskGps(): every complete sentence, exactly once and whole
+static void _taskGps(void)
+{
+	char *s;
+	int i;
+
+	while ((s = USART_getSentence())) {
+		i = _find(s);
+		if (i < 0)
+			_task.bad++;
+		else if ((unsigned)i != _task.next)
+			_task.skipped++;
+		_task.next = (i + 1) % BURST_LEN;
+		_task.got++;
+		USART_releaseSentence();
+	}
+}
+
+/*
+ * Run the bursts at baud, the task held off for holdoff ms at the
+ * first run due after each burst starts. Returns the sentences lost.
+ */
+static unsigned long _run(unsigned long baud, unsigned holdoff,
+						  struct USARTStats *stats)
+{
+	// 10 bits a char, in ns so 38400 baud stays exact enough
+	unsigned long long charNs = 10000000000ULL / baud;
+	unsigned long long now, taskNs = 0, burstNs;
+	const char *c;
+
+	_head = _tail = 0;
+	_len = 0;
+	_drop = 0;
+	USART_resetStats();
+	memset(&_task, 0, sizeof(_task));
+
+	for (unsigned b = 0; b < BURSTS; b++) {
+		burstNs = (unsigned long long)b * (BURST_US + DRIFT_US) * 1000;
+		now = burstNs;
+		for (unsigned i = 0; i < BURST_LEN; i++) {
+			for (c = _burst[i]; *c; c++) {
+				now += charNs;
+				while (taskNs <= now) {
+					_taskGps();
+					taskNs += TASK_MS * 1000000ULL;
+					// The first run of the burst is late
+					if (taskNs > burstNs && taskNs <= burstNs + TASK_MS * 1000000ULL)
+						taskNs += holdoff * 1000000ULL;
+				}
+				UDR1 = *c;
+				USART1_RX_vect();
+			}
+		}
+	}
+	_taskGps();
+	USART_getStats(stats);
+
+	return BURSTS * BURST_LEN - _task.got;
+}
+
+static void _testBaud(unsigned long baud)
+{
+	struct USARTStats stats;
+	unsigned long lost;
+	unsigned holdoff;
+
+	lost = _run(baud, 0, &stats);
+	CHECK(lost == 0 && _task.bad == 0 && _task.skipped == 0);
+	CHECK(stats.overruns == 0 && stats.truncated == 0);
+	printf("%5lu baud: on time at most %u of %u slots used",
+		   baud, stats.maxDepth, USART_SENTENCES);
+
+	// The longest hold-off without a loss, 10 ms steps
+	for (holdoff = 0; holdoff < 2000; holdoff += 10) {
+		if (_run(baud, holdoff + 10, &stats) != 0)
+			break;
+		CHECK(_task.bad == 0 && _task.skipped == 0);
+	}
+	printf(", a hold-off up to %u ms loses nothing\n", holdoff);
+	CHECK(holdoff >= HOLDOFF_MS);
+
+	// Past that the ring drops whole sentences and counts them
+	lost = _run(baud, holdoff + 10, &stats);
+	CHECK(lost > 0 && lost == stats.overruns && _task.bad == 0);
+	CHECK(_task.skipped > 0);
+}
+
+int main(void)
+{
+	_testBaud(9600);
+	_testBaud(38400);
+
+	printf("usarttest: %s\n", _failed ? "FAILED" : "ok");
+
+	return _failed != 0;
+}
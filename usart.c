@@ -1,4 +1,7 @@
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stddef.h>
+#include <string.h>
 #include "usart.h"
 
 void USART_init(uint16_t baud) {
@@ -20,3 +23,78 @@ void USART_init(uint16_t baud) {
     UCSR1C |= (0 << USBS1);				// Stop bit: 1bit
     UCSR1C |= ((1 << UCSZ11) | (1 << UCSZ10));		// Data size: 8bit
 }
+
+/*
+ * Single producer, single consumer: the ISR only moves _head and
+ * the loop only moves _tail, both are single bytes. The slot at
+ * _head is the one being filled, the ones from _tail up to it are
+ * complete and belong to the loop.
+ */
+static char _ring[USART_SENTENCES][USART_SENTENCE_SIZE];
+static volatile uint8_t _head, _tail;
+static uint8_t _len;		// chars in the slot being filled
+static uint8_t _drop;		// skip the rest of the sentence
+static struct USARTStats _stats;
+
+ISR(USART1_RX_vect)
+{
+	char c = UDR1;
+	uint8_t depth = _head - _tail;
+
+	if (_drop) {
+		if (c == '\n')
+			_drop = 0;
+		return;
+	}
+	if (depth == USART_SENTENCES) {
+		// no free slot, lose this sentence rather than a queued one
+		_stats.overruns++;
+		_drop = (c != '\n');
+		return;
+	}
+	if (c == '\n') {
+		_ring[_head & (USART_SENTENCES - 1)][_len] = '\0';
+		_len = 0;
+		_head++;
+		_stats.sentences++;
+		if (++depth > _stats.maxDepth)
+			_stats.maxDepth = depth;
+	} else if (_len < USART_SENTENCE_SIZE - 1) {
+		_ring[_head & (USART_SENTENCES - 1)][_len++] = c;
+	} else {
+		_stats.truncated++;
+		_len = 0;
+		_drop = 1;
+	}
+}
+
+char *USART_getSentence(void)
+{
+	if (_tail == _head)
+		return NULL;
+	return _ring[_tail & (USART_SENTENCES - 1)];
+}
+
+void USART_releaseSentence(void)
+{
+	if (_tail != _head)
+		_tail++;
+}
+
+void USART_getStats(struct USARTStats *stats)
+{
+	uint8_t oldSREG = SREG;
+
+	cli();
+	*stats = _stats;
+	SREG = oldSREG;
+}
+
+void USART_resetStats(void)
+{
+	uint8_t oldSREG = SREG;
+
+	cli();
+	memset(&_stats, 0, sizeof(_stats));
+	SREG = oldSREG;
+}
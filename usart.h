@@ -1,6 +1,34 @@
 #ifndef _USART_H_
 #define _USART_H_
 
+#include <inttypes.h>
+
+/*
+ * Received sentences are kept in a ring of USART_SENTENCES slots
+ * filled by the RX interrupt, the longest NMEA sentence is 82 chars
+ * with CR/LF. A sentence is dropped when the ring is full or it
+ * doesn't fit a slot, the ones already queued are kept.
+ * The ring holds the whole 1 Hz burst of a receiver (7 sentences),
+ * so the GPS task can be held off for up to ~900 ms at 9600 and
+ * 38400 baud without a loss; tools/usarttest checks this.
+ */
+#define USART_SENTENCES			8		// power of two
+#define USART_SENTENCE_SIZE		84		// with the terminating NUL
+
+struct USARTStats {
+	uint16_t sentences;		// queued
+	uint16_t overruns;		// dropped, the ring was full
+	uint16_t truncated;		// dropped, too long
+	uint8_t maxDepth;		// most sentences waiting at once
+};
+
 void USART_init(uint16_t baud);
 
+// Oldest complete sentence (LF stripped) or NULL, owned until released
+char *USART_getSentence(void);
+void USART_releaseSentence(void);
+
+void USART_getStats(struct USARTStats *stats);
+void USART_resetStats(void);
+
 #endif /* _USART_H_ */